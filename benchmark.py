@@ -8,7 +8,14 @@ executables = [
     "kmeans-serial",
     "kmeans-gpu-v1",
     "kmeans-gpu-v2",
-    "kmeans-gpu-v3"
+    "kmeans-gpu-v3",
+    "kmeans-gpu-v2-det",
+    "kmeans-gpu-v3-det",
+    "kmeans-gpu-v3-reorder",
+    "kmeans-kdtree",
+    "kmeans-reduced",
+    "kmeans-coreset",
+    "kmeans-autotune"
 ]
 
 dataset = "datasets/dataset7.txt"
@@ -38,8 +45,8 @@ for exe in executables:
             # Each valid line is expected to be: K_value,AverageTimeMicroseconds
             parts = line.split(',')
             if len(parts) >= 2:
-                # Prepend the executable version to the row.
-                results.append([exe] + parts)
+                # Prepend the executable version to the row; extra columns are ignored.
+                results.append([exe] + parts[:2])
 
 # Write the combined results to a CSV file.
 output_file = "results.csv"
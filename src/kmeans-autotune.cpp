@@ -0,0 +1,703 @@
+// Implementation of the KMeans Algorithm with a CPU autotuner
+//
+// Three CPU engines are available: plain Lloyd, Hamerly's bounds-based algorithm, and a blocked
+// engine that computes |c|^2 - 2 x.c over tiles of points and centroids with SIMD dot products.
+// Before clustering a shape (N, D, K) for the first time, short calibration passes on a sample
+// of the points time every combination of engine, precision, thread count and tile sizes over
+// the same window of iterations after a warm-up; the fastest one (float only if its inertia on
+// the sample matches double) is stored in TUNE_CACHE, keyed by machine and shape, and reused.
+// Invalid cache entries are ignored and the shape is tuned again; the time spent tuning is
+// printed as TUNING TIME.
+//
+// The distance metric is a compile-time policy (METRIC): L2Metric for squared Euclidean distance,
+// or CosineMetric for spherical k-means, where the points are normalised once and the centroids
+// are renormalised after every update, so the nearest centroid is the one with the largest dot
+// product and the same kernels serve both metrics without a per-element branch.
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <random>
+#include <climits>
+#include <thread>
+#include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "result_writer.h"
+
+// file holding the tuned configurations
+#ifndef TUNE_CACHE
+#define TUNE_CACHE "kmeans-tune.cache"
+#endif
+
+// size of the calibration sample, untimed warm-up iterations and iterations timed per candidate
+#ifndef CALIBRATION_POINTS
+#define CALIBRATION_POINTS 4096
+#endif
+#ifndef CALIBRATION_WARMUP
+#define CALIBRATION_WARMUP 3
+#endif
+#ifndef CALIBRATION_ITERATIONS
+#define CALIBRATION_ITERATIONS 5
+#endif
+
+// largest relative inertia increase on the sample for which float is accepted over double
+#ifndef FLOAT_TOLERANCE
+#define FLOAT_TOLERANCE 1e-4
+#endif
+
+using namespace std;
+using namespace std::chrono;
+
+// squared Euclidean distance
+struct L2Metric
+{
+	static constexpr const char *name = "l2";
+
+	template <typename T>
+	static T distance(const T *a, const T *b, int total_values)
+	{
+		T sum = 0;
+		#pragma omp simd reduction(+:sum)
+		for (int j = 0; j < total_values; j++) {
+			T diff = a[j] - b[j];
+			sum += diff * diff;
+		}
+		return sum;
+	}
+
+	// ranks centroids by |x - c|^2 - |x|^2
+	template <typename T>
+	static T score(T centroid_norm, T dot)
+	{
+		return centroid_norm - 2 * dot;
+	}
+
+	template <typename T>
+	static void normalize(T *values, int total_values)
+	{
+	}
+};
+
+// cosine distance on unit vectors: 1 - x.c, which is half the squared Euclidean distance
+struct CosineMetric
+{
+	static constexpr const char *name = "cosine";
+
+	template <typename T>
+	static T distance(const T *a, const T *b, int total_values)
+	{
+		T dot = 0;
+		#pragma omp simd reduction(+:dot)
+		for (int j = 0; j < total_values; j++)
+			dot += a[j] * b[j];
+		return max((T)0, 1 - dot);
+	}
+
+	// the nearest centroid has the largest dot product
+	template <typename T>
+	static T score(T centroid_norm, T dot)
+	{
+		return -dot;
+	}
+
+	template <typename T>
+	static void normalize(T *values, int total_values)
+	{
+		T norm = 0;
+		for (int j = 0; j < total_values; j++)
+			norm += values[j] * values[j];
+		if (norm == 0)
+			return;
+		norm = sqrt(norm);
+		for (int j = 0; j < total_values; j++)
+			values[j] /= norm;
+	}
+};
+
+#ifndef METRIC
+#define METRIC L2Metric
+#endif
+
+enum EngineType
+{
+	ENGINE_LLOYD,
+	ENGINE_HAMERLY,
+	ENGINE_BLOCKED
+};
+
+const char *engine_names[] = { "lloyd", "hamerly", "blocked" };
+
+struct TuneConfig
+{
+	int engine;
+	int single_precision;  // 1: distances in float, 0: in double
+	int threads;
+	int tile_points, tile_centroids;  // only used by the blocked engine
+};
+
+template <typename T, typename Metric>
+class KMeans
+{
+private:
+	int K;
+	int total_values, total_points, max_iterations;
+	TuneConfig config;
+	vector<T> centroids;  // K * total_values
+	vector<int> assignments;
+	int iterations;
+
+	// Hamerly bounds: distance to the assigned centroid and lower bound on the others
+	vector<T> upper, lower;
+
+	T distance(const T *a, const T *b) const
+	{
+		return Metric::distance(a, b, total_values);
+	}
+
+	// return ID of nearest center
+	int getIDNearestCenter(const T *point) const
+	{
+		T min_dist = INFINITY;
+		int id_cluster_center = 0;
+
+		for (int c = 0; c < K; c++) {
+			T dist = distance(point, &centroids[(size_t)c * total_values]);
+			if (dist < min_dist) {
+				min_dist = dist;
+				id_cluster_center = c;
+			}
+		}
+		return id_cluster_center;
+	}
+
+	int assignLloyd(const T *data)
+	{
+		int changed = 0;
+
+		#pragma omp parallel for num_threads(config.threads) reduction(+:changed) schedule(static)
+		for (int i = 0; i < total_points; i++) {
+			int c = getIDNearestCenter(&data[(size_t)i * total_values]);
+			if (assignments[i] != c) {
+				assignments[i] = c;
+				changed = 1;
+			}
+		}
+		return changed;
+	}
+
+	// scores x.c for a tile of points against a tile of centroids at a time
+	int assignBlocked(const T *data)
+	{
+		vector<T> norms(K);
+		for (int c = 0; c < K; c++) {
+			const T *centroid = &centroids[(size_t)c * total_values];
+			T norm = 0;
+			#pragma omp simd reduction(+:norm)
+			for (int j = 0; j < total_values; j++)
+				norm += centroid[j] * centroid[j];
+			norms[c] = norm;
+		}
+
+		int changed = 0;
+		int tile_points = config.tile_points, tile_centroids = config.tile_centroids;
+
+		#pragma omp parallel num_threads(config.threads) reduction(+:changed)
+		{
+			vector<T> best_score(tile_points);
+			vector<int> best_id(tile_points);
+
+			#pragma omp for schedule(static)
+			for (int tile = 0; tile < total_points; tile += tile_points) {
+				int tile_end = min(tile + tile_points, total_points);
+				fill(best_score.begin(), best_score.end(), (T)INFINITY);
+
+				for (int c0 = 0; c0 < K; c0 += tile_centroids) {
+					int c1 = min(c0 + tile_centroids, K);
+					for (int i = tile; i < tile_end; i++) {
+						const T *point = &data[(size_t)i * total_values];
+						for (int c = c0; c < c1; c++) {
+							const T *centroid = &centroids[(size_t)c * total_values];
+							T dot = 0;
+							#pragma omp simd reduction(+:dot)
+							for (int j = 0; j < total_values; j++)
+								dot += point[j] * centroid[j];
+
+							T score = Metric::score(norms[c], dot);
+							if (score < best_score[i - tile]) {
+								best_score[i - tile] = score;
+								best_id[i - tile] = c;
+							}
+						}
+					}
+				}
+
+				for (int i = tile; i < tile_end; i++) {
+					if (assignments[i] != best_id[i - tile]) {
+						assignments[i] = best_id[i - tile];
+						changed = 1;
+					}
+				}
+			}
+		}
+		return changed;
+	}
+
+	// skips the points whose bounds prove that their centroid is still the nearest
+	int assignHamerly(const T *data)
+	{
+		// half the distance from each centroid to its nearest other centroid
+		vector<T> half_gap(K, (T)INFINITY);
+		for (int c = 0; c < K; c++) {
+			for (int o = 0; o < K; o++) {
+				if (o != c)
+					half_gap[c] = min(half_gap[c], sqrt(distance(&centroids[(size_t)c * total_values],
+																 &centroids[(size_t)o * total_values])) / 2);
+			}
+		}
+
+		int changed = 0;
+
+		#pragma omp parallel for num_threads(config.threads) reduction(+:changed) schedule(static)
+		for (int i = 0; i < total_points; i++) {
+			const T *point = &data[(size_t)i * total_values];
+			int a = max(assignments[i], 0);
+			T bound = max(half_gap[a], lower[i]);
+			if (upper[i] <= bound)
+				continue;
+
+			upper[i] = sqrt(distance(point, &centroids[(size_t)a * total_values]));
+			if (upper[i] <= bound && assignments[i] >= 0)
+				continue;
+
+			T first = INFINITY, second = INFINITY;
+			int id_first = 0;
+			for (int c = 0; c < K; c++) {
+				T dist = distance(point, &centroids[(size_t)c * total_values]);
+				if (dist < first) {
+					second = first;
+					first = dist;
+					id_first = c;
+				} else if (dist < second) {
+					second = dist;
+				}
+			}
+
+			upper[i] = sqrt(first);
+			lower[i] = sqrt(second);
+			if (assignments[i] != id_first) {
+				assignments[i] = id_first;
+				changed = 1;
+			}
+		}
+		return changed;
+	}
+
+	// recalculating the center of each cluster; returns how far each centroid moved
+	vector<T> updateCentroids(const T *data)
+	{
+		vector<double> sums((size_t)K * total_values, 0.0);
+		vector<int> counts(K, 0);
+
+		#pragma omp parallel num_threads(config.threads)
+		{
+			vector<double> partial((size_t)K * total_values, 0.0);
+			vector<int> partial_counts(K, 0);
+
+			#pragma omp for schedule(static)
+			for (int i = 0; i < total_points; i++) {
+				int c = assignments[i];
+				const T *point = &data[(size_t)i * total_values];
+				for (int j = 0; j < total_values; j++)
+					partial[(size_t)c * total_values + j] += point[j];
+				partial_counts[c]++;
+			}
+
+			#pragma omp critical
+			{
+				for (size_t k = 0; k < sums.size(); k++)
+					sums[k] += partial[k];
+				for (int c = 0; c < K; c++)
+					counts[c] += partial_counts[c];
+			}
+		}
+
+		vector<T> moved(K, 0);
+		for (int c = 0; c < K; c++) {
+			if (counts[c] == 0)
+				continue;
+
+			vector<T> old(centroids.begin() + (size_t)c * total_values,
+						  centroids.begin() + (size_t)(c + 1) * total_values);
+			for (int j = 0; j < total_values; j++)
+				centroids[(size_t)c * total_values + j] = sums[(size_t)c * total_values + j] / counts[c];
+			Metric::normalize(&centroids[(size_t)c * total_values], total_values);
+			moved[c] = sqrt(distance(old.data(), &centroids[(size_t)c * total_values]));
+		}
+		return moved;
+	}
+
+	// sets the initial centers and resets the assignments and bounds
+	void start(const vector<T> &data, const vector<int> &initial)
+	{
+		centroids.resize((size_t)K * total_values);
+		for (int c = 0; c < K; c++)
+			copy(&data[(size_t)initial[c] * total_values], &data[(size_t)(initial[c] + 1) * total_values],
+				 &centroids[(size_t)c * total_values]);
+
+		assignments.assign(total_points, -1);
+		if (config.engine == ENGINE_HAMERLY) {
+			upper.assign(total_points, (T)INFINITY);
+			lower.assign(total_points, 0);
+		}
+	}
+
+	// one assignment and update step; returns 1 if any assignment changed
+	int iterate(const T *data)
+	{
+		int changed;
+		if (config.engine == ENGINE_HAMERLY)
+			changed = assignHamerly(data);
+		else if (config.engine == ENGINE_BLOCKED)
+			changed = assignBlocked(data);
+		else
+			changed = assignLloyd(data);
+
+		vector<T> moved = updateCentroids(data);
+
+		if (config.engine == ENGINE_HAMERLY) {
+			T max_moved = *max_element(moved.begin(), moved.end());
+			#pragma omp parallel for num_threads(config.threads) schedule(static)
+			for (int i = 0; i < total_points; i++) {
+				upper[i] += moved[assignments[i]];
+				lower[i] -= max_moved;
+			}
+		}
+		return changed;
+	}
+
+public:
+	KMeans(int K, int total_points, int total_values, int max_iterations, const TuneConfig &config)
+	{
+		this->K = K;
+		this->total_points = total_points;
+		this->total_values = total_values;
+		this->max_iterations = max_iterations;
+		this->config = config;
+	}
+
+	int getIterations() const
+	{
+		return iterations;
+	}
+
+	const vector<int> &getAssignments() const
+	{
+		return assignments;
+	}
+
+	vector<double> getCentroids() const
+	{
+		return vector<double>(centroids.begin(), centroids.end());
+	}
+
+	// clusters the points starting from the given points as centers
+	long long run(const vector<T> &data, const vector<int> &initial)
+	{
+		auto begin = chrono::high_resolution_clock::now();
+
+		if (K > total_points)
+			return 0;
+
+		start(data, initial);
+
+		for (iterations = 1; ; iterations++) {
+			int changed = iterate(data.data());
+			if (changed == 0 || iterations >= max_iterations)
+				break;
+		}
+
+		auto end = chrono::high_resolution_clock::now();
+		return duration_cast<microseconds>(end - begin).count();
+	}
+
+	// time in nanoseconds of `window` iterations after `warmup` untimed ones, without stopping at
+	// convergence, so every engine is measured over the same iterations, past its setup and first pass
+	long long timeWindow(const vector<T> &data, const vector<int> &initial, int warmup, int window)
+	{
+		start(data, initial);
+		for (iterations = 1; iterations <= warmup; iterations++)
+			iterate(data.data());
+
+		auto begin = chrono::high_resolution_clock::now();
+		for (int i = 0; i < window; i++, iterations++)
+			iterate(data.data());
+		auto end = chrono::high_resolution_clock::now();
+
+		return duration_cast<nanoseconds>(end - begin).count();
+	}
+};
+
+// identifies the machine: host name, CPU model and hardware threads
+string machineKey()
+{
+	char host[256] = "unknown";
+	gethostname(host, sizeof(host) - 1);
+
+	string model = "unknown";
+	ifstream cpuinfo("/proc/cpuinfo");
+	string line;
+	while (getline(cpuinfo, line)) {
+		if (line.compare(0, 10, "model name") == 0) {
+			model = line.substr(line.find(':') + 2);
+			break;
+		}
+	}
+
+	string key = string(host) + "/" + model + "/" + to_string(thread::hardware_concurrency());
+	replace(key.begin(), key.end(), ' ', '_');
+	return key;
+}
+
+// identifies the shape; N is rounded down to a power of two so nearby sizes share a tuning
+string shapeKey(int total_points, int total_values, int K)
+{
+	int bucket = 1;
+	while (bucket * 2 <= total_points)
+		bucket *= 2;
+	return to_string(bucket) + " " + to_string(total_values) + " " + to_string(K);
+}
+
+bool loadTuning(const string &key, TuneConfig &config)
+{
+	ifstream cache(TUNE_CACHE);
+	string line;
+	bool found = false;
+
+	// later entries win, so a re-tuned shape replaces the old one; if the latest entry is
+	// malformed or invalid the shape is tuned again
+	while (getline(cache, line)) {
+		size_t split = line.find('|');
+		if (split == string::npos || line.substr(0, split) != key)
+			continue;
+
+		istringstream fields(line.substr(split + 1));
+		string engine;
+		TuneConfig entry;
+		entry.engine = -1;
+		if (fields >> engine >> entry.single_precision >> entry.threads >> entry.tile_points >> entry.tile_centroids) {
+			for (int e = 0; e < 3; e++) {
+				if (engine == engine_names[e])
+					entry.engine = e;
+			}
+		}
+
+		found = entry.engine >= 0 && entry.threads >= 1 &&
+				(entry.engine != ENGINE_BLOCKED || (entry.tile_points >= 1 && entry.tile_centroids >= 1));
+		if (found)
+			config = entry;
+	}
+	return found;
+}
+
+void saveTuning(const string &key, const TuneConfig &config)
+{
+	ofstream cache(TUNE_CACHE, ios::app);
+	cache << key << "|" << engine_names[config.engine] << " " << config.single_precision << " "
+		  << config.threads << " " << config.tile_points << " " << config.tile_centroids << endl;
+}
+
+// time of the same fixed window of iterations for one configuration on the sample
+template <typename T>
+long long calibrate(const vector<T> &sample, int sample_points, int total_values, int K,
+					const vector<int> &initial, const TuneConfig &config)
+{
+	KMeans<T, METRIC> kmeans(K, sample_points, total_values, CALIBRATION_ITERATIONS, config);
+	return kmeans.timeWindow(sample, initial, CALIBRATION_WARMUP, CALIBRATION_ITERATIONS);
+}
+
+// inertia on the sample, in double, of a run of the configuration in precision T
+template <typename T>
+double sampleInertia(const vector<double> &sample, const vector<T> &sample_values, int sample_points,
+					 int total_values, int K, const vector<int> &initial, const TuneConfig &config)
+{
+	KMeans<T, METRIC> kmeans(K, sample_points, total_values, CALIBRATION_WARMUP + CALIBRATION_ITERATIONS, config);
+	kmeans.run(sample_values, initial);
+
+	const vector<int> &assignments = kmeans.getAssignments();
+	vector<double> centroids = kmeans.getCentroids();
+	double inertia = 0.0;
+	for (int i = 0; i < sample_points; i++)
+		inertia += METRIC::distance(&sample[(size_t)i * total_values],
+									&centroids[(size_t)assignments[i] * total_values], total_values);
+	return inertia;
+}
+
+TuneConfig tune(const vector<double> &points, int total_points, int total_values, int K)
+{
+	// calibration sample, drawn without touching rand() so the main runs are unaffected
+	mt19937 generator(10);
+	vector<int> order(total_points);
+	for (int i = 0; i < total_points; i++)
+		order[i] = i;
+	shuffle(order.begin(), order.end(), generator);
+
+	int sample_points = min(total_points, CALIBRATION_POINTS);
+	vector<double> sample((size_t)sample_points * total_values);
+	for (int i = 0; i < sample_points; i++)
+		copy(&points[(size_t)order[i] * total_values], &points[(size_t)(order[i] + 1) * total_values],
+			 &sample[(size_t)i * total_values]);
+	vector<float> sample_float(sample.begin(), sample.end());
+
+	vector<int> initial(K);
+	for (int c = 0; c < K; c++)
+		initial[c] = c;
+
+	int max_threads = 1;
+#ifdef _OPENMP
+	max_threads = omp_get_max_threads();
+#endif
+	vector<int> thread_counts = { 1, max_threads / 2, max_threads };
+	sort(thread_counts.begin(), thread_counts.end());
+	thread_counts.erase(unique(thread_counts.begin(), thread_counts.end()), thread_counts.end());
+	thread_counts.erase(remove(thread_counts.begin(), thread_counts.end(), 0), thread_counts.end());
+
+	vector<TuneConfig> candidates;
+	for (int precision = 0; precision < 2; precision++) {
+		for (int threads : thread_counts) {
+			candidates.push_back({ ENGINE_LLOYD, precision, threads, 0, 0 });
+			candidates.push_back({ ENGINE_HAMERLY, precision, threads, 0, 0 });
+			for (int tile_points : { 64, 256 })
+				for (int tile_centroids : { 4, 16 })
+					candidates.push_back({ ENGINE_BLOCKED, precision, threads, tile_points, tile_centroids });
+		}
+	}
+
+	// fastest configuration of each precision
+	TuneConfig best[2];
+	long long best_time[2] = { LLONG_MAX, LLONG_MAX };
+	for (const TuneConfig &config : candidates) {
+		long long time = config.single_precision ?
+			calibrate(sample_float, sample_points, total_values, K, initial, config) :
+			calibrate(sample, sample_points, total_values, K, initial, config);
+		if (time < best_time[config.single_precision]) {
+			best_time[config.single_precision] = time;
+			best[config.single_precision] = config;
+		}
+	}
+
+	if (best_time[1] >= best_time[0])
+		return best[0];
+
+	// float is only accepted if its clustering of the sample is as good as the double one
+	TuneConfig same_in_double = best[1];
+	same_in_double.single_precision = 0;
+	double inertia_double = sampleInertia(sample, sample, sample_points, total_values, K, initial, same_in_double);
+	double inertia_float = sampleInertia(sample, sample_float, sample_points, total_values, K, initial, best[1]);
+
+	if (inertia_float <= inertia_double * (1 + FLOAT_TOLERANCE))
+		return best[1];
+	return best[0];
+}
+
+int main(int argc, char *argv[])
+{
+	srand(10);
+
+	int total_points, total_values, K, max_iterations, has_name;
+
+	cin >> total_points >> total_values >> K >> max_iterations >> has_name;
+
+	vector<double> points((size_t)total_points * total_values);
+	vector<string> names(total_points);
+
+	for (int i = 0; i < total_points; i++)
+	{
+		for (int j = 0; j < total_values; j++)
+			cin >> points[(size_t)i * total_values + j];
+
+		if (has_name)
+			cin >> names[i];
+
+		METRIC::normalize(&points[(size_t)i * total_values], total_values);
+	}
+	vector<float> points_float(points.begin(), points.end());
+
+	ResultWriter writer(total_points, total_values, points, std::move(names));
+	string machine = machineKey();
+	int k_vals[] = {2, 3, 5, 10, 20};
+
+	// configurations come from the cache; shapes seen for the first time are tuned up front
+	vector<TuneConfig> configs(5);
+	int tuned = 0;
+	auto tuning_begin = chrono::high_resolution_clock::now();
+	for (int k = 0; k < 5; k++) {
+		if (k_vals[k] > total_points)
+			continue;
+
+		string key = machine + " " + METRIC::name + " " + shapeKey(total_points, total_values, k_vals[k]);
+		if (!loadTuning(key, configs[k])) {
+			configs[k] = tune(points, total_points, total_values, k_vals[k]);
+			saveTuning(key, configs[k]);
+			tuned++;
+		}
+	}
+	auto tuning_end = chrono::high_resolution_clock::now();
+	cout << "TUNING TIME = " << duration_cast<microseconds>(tuning_end - tuning_begin).count()
+		 << " (" << tuned << " shapes tuned)" << endl;
+
+	cout << "K,AverageTimeMicroseconds,Engine,SinglePrecision,Threads,TilePoints,TileCentroids" << endl;
+	for (int k = 0; k < 5; k++) {
+		int K = k_vals[k];
+		if (K > total_points) {
+			cout << K << ",0,none,0,0,0,0" << endl;
+			continue;
+		}
+		const TuneConfig &config = configs[k];
+
+		long long total_time = 0;
+		int numRuns = 25;
+		for (int r = 0; r < numRuns; r++) {
+			// choose K distinct values for the centers of the clusters
+			vector<int> initial;
+			while ((int)initial.size() < K) {
+				int index_point = rand() % total_points;
+				if (find(initial.begin(), initial.end(), index_point) == initial.end())
+					initial.push_back(index_point);
+			}
+
+			RunResult result;
+			if (config.single_precision) {
+				KMeans<float, METRIC> kmeans(K, total_points, total_values, max_iterations, config);
+				result.total_time = kmeans.run(points_float, initial);
+				result.assignments = kmeans.getAssignments();
+				result.centroids = kmeans.getCentroids();
+			} else {
+				KMeans<double, METRIC> kmeans(K, total_points, total_values, max_iterations, config);
+				result.total_time = kmeans.run(points, initial);
+				result.assignments = kmeans.getAssignments();
+				result.centroids = kmeans.getCentroids();
+			}
+			result.K = K;
+			result.run = r;
+			result.phase1_time = 0;
+			total_time += result.total_time;
+			writer.submit(move(result));
+		}
+		writer.finishK();
+
+		long long avg_time = total_time / numRuns;
+		cout << K << "," << avg_time << "," << engine_names[config.engine] << "," << config.single_precision
+			 << "," << config.threads << "," << config.tile_points << "," << config.tile_centroids << endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,436 @@
+// Batched KMeans over many small datasets in a single process
+//
+// Reads a manifest from standard input with one dataset per line:
+//     path [K] [max_iterations] [runs]
+// where K and max_iterations default to the values in the dataset header and runs defaults to 1.
+// Blank lines and lines starting with '#' are ignored. Every dataset is loaded and clustered as
+// tasks on a shared work-stealing pool; each worker keeps an arena of buffers that is reused by
+// all the jobs it runs, and the results of every job stream to a single ResultWriter.
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <random>
+#include "result_writer.h"
+
+// number of worker threads; 0 uses one per hardware thread
+#ifndef BATCH_THREADS
+#define BATCH_THREADS 0
+#endif
+
+using namespace std;
+using namespace std::chrono;
+
+// buffers owned by one worker and reused across the jobs it runs
+struct Arena
+{
+	string file_contents;
+	vector<double> centroids;
+	vector<double> sums;
+	vector<int> counts;
+	vector<int> assignments;
+};
+
+struct BatchJob
+{
+	string path;
+	int K, max_iterations, runs;  // 0 means "from the dataset header"
+};
+
+struct Dataset
+{
+	string path;
+	int total_points, total_values, K, max_iterations, runs;
+	vector<double> values;  // total_points * total_values
+};
+
+// pool of workers with one deque each; a worker pops its own newest task and,
+// when it runs out, steals the oldest task of another worker
+class WorkStealingPool
+{
+private:
+	struct WorkerQueue
+	{
+		mutex lock;
+		deque<function<void(int)>> tasks;
+	};
+
+	int total_workers;
+	vector<unique_ptr<WorkerQueue>> queues;
+	vector<thread> workers;
+	vector<Arena> arenas;
+
+	mutex idle_lock;
+	condition_variable idle;
+	atomic<long long> pending;  // submitted tasks that have not finished
+	atomic<int> next_queue;
+	bool stopping;
+
+	bool pop(int worker, function<void(int)> &task)
+	{
+		{
+			WorkerQueue &own = *queues[worker];
+			lock_guard<mutex> guard(own.lock);
+			if (!own.tasks.empty()) {
+				task = move(own.tasks.back());
+				own.tasks.pop_back();
+				return true;
+			}
+		}
+
+		for (int k = 1; k < total_workers; k++) {
+			WorkerQueue &victim = *queues[(worker + k) % total_workers];
+			lock_guard<mutex> guard(victim.lock);
+			if (!victim.tasks.empty()) {
+				task = move(victim.tasks.front());
+				victim.tasks.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void work(int worker)
+	{
+		while (true) {
+			function<void(int)> task;
+
+			if (pop(worker, task)) {
+				task(worker);
+				if (--pending == 0) {
+					lock_guard<mutex> guard(idle_lock);
+					idle.notify_all();
+				}
+				continue;
+			}
+
+			unique_lock<mutex> guard(idle_lock);
+			if (stopping)
+				return;
+			idle.wait_for(guard, milliseconds(1));
+		}
+	}
+
+	void push(int worker, function<void(int)> &&task)
+	{
+		++pending;
+		{
+			WorkerQueue &queue = *queues[worker];
+			lock_guard<mutex> guard(queue.lock);
+			queue.tasks.push_back(move(task));
+		}
+		idle.notify_one();
+	}
+
+public:
+	WorkStealingPool(int total_workers) : total_workers(total_workers), arenas(total_workers),
+		pending(0), next_queue(0), stopping(false)
+	{
+		for (int i = 0; i < total_workers; i++)
+			queues.push_back(unique_ptr<WorkerQueue>(new WorkerQueue));
+		for (int i = 0; i < total_workers; i++)
+			workers.push_back(thread(&WorkStealingPool::work, this, i));
+	}
+
+	~WorkStealingPool()
+	{
+		{
+			lock_guard<mutex> guard(idle_lock);
+			stopping = true;
+		}
+		idle.notify_all();
+		for (thread &worker : workers)
+			worker.join();
+	}
+
+	// submits from outside the pool, spreading the tasks over the workers
+	void submit(function<void(int)> &&task)
+	{
+		push(next_queue++ % total_workers, move(task));
+	}
+
+	// submits from inside a task, onto the queue of the running worker
+	void spawn(int worker, function<void(int)> &&task)
+	{
+		push(worker, move(task));
+	}
+
+	Arena &getArena(int worker)
+	{
+		return arenas[worker];
+	}
+
+	void wait()
+	{
+		unique_lock<mutex> guard(idle_lock);
+		idle.wait(guard, [this] { return pending == 0; });
+	}
+};
+
+// parses a dataset in the usual text format; names are skipped
+bool loadDataset(const BatchJob &job, Arena &arena, Dataset &data)
+{
+	ifstream file(job.path, ios::binary);
+	if (!file)
+		return false;
+
+	file.seekg(0, ios::end);
+	arena.file_contents.resize(file.tellg());
+	file.seekg(0, ios::beg);
+	file.read(&arena.file_contents[0], arena.file_contents.size());
+
+	const char *cursor = arena.file_contents.c_str();
+	char *next;
+	int header[5];
+	for (int h = 0; h < 5; h++) {
+		header[h] = strtol(cursor, &next, 10);
+		if (next == cursor)
+			return false;
+		cursor = next;
+	}
+
+	int has_name = header[4];
+	data.path = job.path;
+	data.total_points = header[0];
+	data.total_values = header[1];
+	data.K = job.K > 0 ? job.K : header[2];
+	data.max_iterations = job.max_iterations > 0 ? job.max_iterations : header[3];
+	data.runs = job.runs > 0 ? job.runs : 1;
+	data.values.resize((size_t)data.total_points * data.total_values);
+
+	for (int i = 0; i < data.total_points; i++) {
+		for (int j = 0; j < data.total_values; j++) {
+			data.values[(size_t)i * data.total_values + j] = strtod(cursor, &next);
+			if (next == cursor)
+				return false;
+			cursor = next;
+		}
+
+		if (has_name) {
+			while (*cursor == ' ' || *cursor == '\t' || *cursor == '\r' || *cursor == '\n')
+				cursor++;
+			while (*cursor != '\0' && *cursor != ' ' && *cursor != '\t' && *cursor != '\r' && *cursor != '\n')
+				cursor++;
+		}
+	}
+	return true;
+}
+
+class KMeans
+{
+private:
+	int K;
+	int total_values, total_points, max_iterations;
+	Arena &arena;
+
+	// return ID of nearest center and its squared distance
+	int getIDNearestCenter(const double *point, double &min_dist) const
+	{
+		int id_cluster_center = 0;
+		min_dist = INFINITY;
+
+		for (int c = 0; c < K; c++) {
+			const double *centroid = &arena.centroids[(size_t)c * total_values];
+			double sum = 0.0;
+			for (int j = 0; j < total_values; j++) {
+				double diff = centroid[j] - point[j];
+				sum += diff * diff;
+			}
+			if (sum < min_dist) {
+				min_dist = sum;
+				id_cluster_center = c;
+			}
+		}
+		return id_cluster_center;
+	}
+
+public:
+	KMeans(int K, int total_points, int total_values, int max_iterations, Arena &arena) : arena(arena)
+	{
+		this->K = K;
+		this->total_points = total_points;
+		this->total_values = total_values;
+		this->max_iterations = max_iterations;
+	}
+
+	// clusters the points into the arena; returns the inertia of the result
+	double run(const vector<double> &values, mt19937 &generator)
+	{
+		arena.centroids.assign((size_t)K * total_values, 0.0);
+		arena.sums.resize((size_t)K * total_values);
+		arena.counts.resize(K);
+		arena.assignments.assign(total_points, -1);
+
+		// choose K distinct values for the centers of the clusters
+		vector<int> prohibited_indexes;
+		uniform_int_distribution<int> pick(0, total_points - 1);
+		for (int i = 0; i < K; i++) {
+			while (true) {
+				int index_point = pick(generator);
+
+				if (find(prohibited_indexes.begin(), prohibited_indexes.end(),
+						 index_point) == prohibited_indexes.end()) {
+					prohibited_indexes.push_back(index_point);
+					copy(&values[(size_t)index_point * total_values],
+						 &values[(size_t)(index_point + 1) * total_values],
+						 &arena.centroids[(size_t)i * total_values]);
+					break;
+				}
+			}
+		}
+
+		double inertia = 0.0;
+		for (int iter = 1; ; iter++) {
+			bool done = true;
+			inertia = 0.0;
+			fill(arena.sums.begin(), arena.sums.end(), 0.0);
+			fill(arena.counts.begin(), arena.counts.end(), 0);
+
+			// associates each point to the nearest center
+			for (int i = 0; i < total_points; i++) {
+				const double *point = &values[(size_t)i * total_values];
+				double dist;
+				int c = getIDNearestCenter(point, dist);
+				inertia += dist;
+
+				if (arena.assignments[i] != c) {
+					arena.assignments[i] = c;
+					done = false;
+				}
+
+				double *sum = &arena.sums[(size_t)c * total_values];
+				for (int j = 0; j < total_values; j++)
+					sum[j] += point[j];
+				arena.counts[c]++;
+			}
+
+			if (done || iter >= max_iterations)
+				break;
+
+			// recalculating the center of each cluster
+			for (int c = 0; c < K; c++) {
+				if (arena.counts[c] == 0)
+					continue;
+				for (int j = 0; j < total_values; j++)
+					arena.centroids[(size_t)c * total_values + j] =
+						arena.sums[(size_t)c * total_values + j] / arena.counts[c];
+			}
+		}
+
+		return inertia;
+	}
+};
+
+// clusters one dataset and streams its runs to the writer; returns false if K does not fit the dataset
+bool clusterDataset(const Dataset &data, int dataset_index, Arena &arena, ResultWriter &writer)
+{
+	if (data.K <= 0 || data.K > data.total_points)
+		return false;
+
+	mt19937 generator(10 + dataset_index);
+	RunResult best;
+	best.inertia = INFINITY;
+
+	for (int r = 0; r < data.runs; r++) {
+		auto begin = chrono::high_resolution_clock::now();
+		KMeans kmeans(data.K, data.total_points, data.total_values, data.max_iterations, arena);
+		double inertia = kmeans.run(data.values, generator);
+		auto end = chrono::high_resolution_clock::now();
+
+		if (RESULT_BEST_ONLY && inertia >= best.inertia)
+			continue;
+
+		RunResult result;
+		result.dataset = data.path;
+		result.K = data.K;
+		result.run = r;
+		result.total_time = duration_cast<microseconds>(end - begin).count();
+		result.phase1_time = 0;
+		result.inertia = inertia;
+		result.assignments = arena.assignments;
+		result.centroids = arena.centroids;
+
+		if (RESULT_BEST_ONLY)
+			best = move(result);
+		else
+			writer.submit(move(result));
+	}
+
+	if (RESULT_BEST_ONLY)
+		writer.submit(move(best));
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	vector<BatchJob> jobs;
+	string line;
+
+	while (getline(cin, line))
+	{
+		istringstream fields(line);
+		BatchJob job = { "", 0, 0, 0 };
+
+		if (!(fields >> job.path) || job.path[0] == '#')
+			continue;
+		fields >> job.K >> job.max_iterations >> job.runs;
+		jobs.push_back(job);
+	}
+
+	int total_threads = BATCH_THREADS > 0 ? BATCH_THREADS : max(1u, thread::hardware_concurrency());
+	atomic<int> failed(0), skipped(0);
+
+	auto begin = chrono::high_resolution_clock::now();
+	{
+		ResultWriter writer;
+		WorkStealingPool pool(total_threads);
+
+		for (size_t d = 0; d < jobs.size(); d++)
+		{
+			// loading is a task too; the clustering job is spawned on the worker that loaded the data
+			pool.submit([&, d](int worker) {
+				shared_ptr<Dataset> data(new Dataset);
+				if (!loadDataset(jobs[d], pool.getArena(worker), *data)) {
+					cerr << "Could not load " << jobs[d].path << endl;
+					failed++;
+					return;
+				}
+
+				pool.spawn(worker, [&, d, data](int owner) {
+					if (!clusterDataset(*data, d, pool.getArena(owner), writer)) {
+						cerr << "Skipped " << jobs[d].path << ": K = " << data->K
+							 << " does not fit " << data->total_points << " points" << endl;
+						skipped++;
+					}
+				});
+			});
+		}
+
+		pool.wait();
+	}
+	auto end = chrono::high_resolution_clock::now();
+
+	long long duration = duration_cast<microseconds>(end - begin).count();
+	// only the datasets that were actually clustered count towards the throughput
+	int clustered = jobs.size() - failed - skipped;
+
+	cout << "Datasets,Threads,TotalTimeMicroseconds,DatasetsPerSecond" << endl;
+	cout << clustered << "," << total_threads << "," << duration << ","
+		 << (duration > 0 ? clustered * 1e6 / duration : 0.0) << endl;
+
+	return failed > 0 ? -1 : 0;
+}
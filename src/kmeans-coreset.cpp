@@ -0,0 +1,448 @@
+// Implementation of the KMeans Algorithm on a lightweight coreset of the points
+// reference: Bachem, Lucic and Krause, "Scalable k-Means Clustering via Lightweight Coresets"
+//
+// The coreset is a weighted sample built in two passes over the points: the first computes the
+// mean and the total squared distance to it, the second samples each point with probability
+// proportional to q(x) = 1/(2N) + d(x, mean)^2 / (2 sum d^2). Weighted Lloyd runs on the sample,
+// and a final assignment pass over all the points reports the quality of the result.
+//
+// With CORESET_OUTPUT set to a path, the sample is also written there as a weighted dataset that
+// kmeans-serial and kmeans-gpu-v2 read when built with -DWEIGHTED_POINTS.
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <math.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// expected size of the coreset as a fraction of the points, and its lower bound
+#ifndef CORESET_FRACTION
+#define CORESET_FRACTION 0.05
+#endif
+#ifndef CORESET_MIN_SIZE
+#define CORESET_MIN_SIZE 200
+#endif
+
+// 1: assign every original point to the coreset centroids at the end of each run
+#ifndef FULL_ASSIGNMENT
+#define FULL_ASSIGNMENT 1
+#endif
+
+using namespace std;
+using namespace std::chrono;
+
+class Point
+{
+private:
+	int id_point, id_cluster;
+	vector<double> values;
+	int total_values;
+	double weight;
+	string name;
+
+public:
+	Point(int id_point, vector<double> &values, string name = "", double weight = 1.0)
+	{
+		this->id_point = id_point;
+		total_values = values.size();
+
+		for (int i = 0; i < total_values; i++)
+			this->values.push_back(values[i]);
+
+		this->name = name;
+		this->weight = weight;
+		id_cluster = -1;
+	}
+
+	int getID() const
+	{
+		return id_point;
+	}
+
+	void setCluster(int id_cluster)
+	{
+		this->id_cluster = id_cluster;
+	}
+
+	int getCluster() const
+	{
+		return id_cluster;
+	}
+
+	double getValue(int index) const
+	{
+		return values[index];
+	}
+
+	const vector<double> &getValues() const
+	{
+		return values;
+	}
+
+	int getTotalValues() const
+	{
+		return total_values;
+	}
+
+	double getWeight() const
+	{
+		return weight;
+	}
+
+	string getName() const
+	{
+		return name;
+	}
+};
+
+// deterministic uniform number in [0, 1) for point i, independent of the thread count
+double uniformHash(uint64_t seed, uint64_t i)
+{
+	uint64_t z = seed + (i + 1) * 0x9E3779B97F4A7C15ULL;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	z = z ^ (z >> 31);
+	return (z >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// weighted sample of the points with expected size coreset_size
+vector<Point> buildCoreset(const vector<Point> &points, int total_values, int coreset_size)
+{
+	int total_points = points.size();
+
+	// first pass: mean and sum of squared distances to it, shifted by the first point
+	// to avoid cancellation in sum |x - s|^2 - N |mean - s|^2
+	vector<double> shifted_sum(total_values, 0.0);
+	double shifted_norms = 0.0;
+
+	#pragma omp parallel
+	{
+		vector<double> partial(total_values, 0.0);
+		double partial_norms = 0.0;
+
+		#pragma omp for schedule(static)
+		for (int i = 0; i < total_points; i++) {
+			for (int j = 0; j < total_values; j++) {
+				double v = points[i].getValue(j) - points[0].getValue(j);
+				partial[j] += v;
+				partial_norms += v * v;
+			}
+		}
+
+		#pragma omp critical
+		{
+			for (int j = 0; j < total_values; j++)
+				shifted_sum[j] += partial[j];
+			shifted_norms += partial_norms;
+		}
+	}
+
+	vector<double> mean(total_values);
+	double mean_shift = 0.0;
+	for (int j = 0; j < total_values; j++) {
+		double m = shifted_sum[j] / total_points;
+		mean[j] = points[0].getValue(j) + m;
+		mean_shift += m * m;
+	}
+	double total_distance = max(shifted_norms - total_points * mean_shift, 0.0);
+
+	// second pass: keep point i with probability p = min(1, m q(x)) and weight 1 / p
+	vector<double> probabilities(total_points);
+
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < total_points; i++) {
+		double dist = 0.0;
+		for (int j = 0; j < total_values; j++) {
+			double diff = points[i].getValue(j) - mean[j];
+			dist += diff * diff;
+		}
+
+		double q = 0.5 / total_points;
+		if (total_distance > 0.0)
+			q += 0.5 * dist / total_distance;
+		else
+			q += 0.5 / total_points;
+
+		double p = min(1.0, coreset_size * q);
+		probabilities[i] = (uniformHash(10, i) < p) ? p : 0.0;
+	}
+
+	vector<Point> coreset;
+	for (int i = 0; i < total_points; i++) {
+		if (probabilities[i] > 0.0) {
+			vector<double> values = points[i].getValues();
+			coreset.push_back(Point(i, values, points[i].getName(), 1.0 / probabilities[i]));
+		}
+	}
+	return coreset;
+}
+
+// writes the coreset in the WEIGHTED_POINTS format: values, weight and optional name per line
+bool writeCoreset(const char *path, const vector<Point> &coreset, int total_values, int K,
+				  int max_iterations, int has_name)
+{
+	ofstream file(path);
+	if (!file)
+		return false;
+
+	file << coreset.size() << " " << total_values << " " << K << " " << max_iterations << " " << has_name << "\n";
+	file << setprecision(17);
+	for (const Point &point : coreset)
+	{
+		for (int j = 0; j < total_values; j++)
+			file << point.getValue(j) << " ";
+		file << point.getWeight();
+		if (has_name)
+			file << " " << point.getName();
+		file << "\n";
+	}
+	return bool(file);
+}
+
+class KMeans
+{
+private:
+	int K;
+	int total_values, max_iterations;
+	vector<double> centroids;  // K * total_values
+	double coreset_inertia, full_inertia;
+	bool completed;
+
+	// return ID of nearest center and its squared distance
+	int getIDNearestCenter(const Point &point, double &min_dist) const
+	{
+		int id_cluster_center = 0;
+		min_dist = INFINITY;
+
+		for (int c = 0; c < K; c++) {
+			double sum = 0.0;
+			for (int j = 0; j < total_values; j++) {
+				double diff = centroids[(size_t)c * total_values + j] - point.getValue(j);
+				sum += diff * diff;
+			}
+			if (sum < min_dist) {
+				min_dist = sum;
+				id_cluster_center = c;
+			}
+		}
+		return id_cluster_center;
+	}
+
+public:
+	KMeans(int K, int total_values, int max_iterations)
+	{
+		this->K = K;
+		this->total_values = total_values;
+		this->max_iterations = max_iterations;
+		coreset_inertia = full_inertia = NAN;
+		completed = false;
+	}
+
+	// false if the run was skipped because there were fewer points than clusters
+	bool hasCompleted() const
+	{
+		return completed;
+	}
+
+	double getCoresetInertia() const
+	{
+		return coreset_inertia;
+	}
+
+	double getFullInertia() const
+	{
+		return full_inertia;
+	}
+
+	long long run(vector<Point> &coreset, vector<Point> &points)
+	{
+		auto begin = chrono::high_resolution_clock::now();
+
+		int total_points = coreset.size();
+		if (K > total_points)
+			return 0;
+
+		vector<int> prohibited_indexes;
+		centroids.assign((size_t)K * total_values, 0.0);
+
+		// choose K distinct values for the centers of the clusters
+		for (int i = 0; i < K; i++)
+		{
+			while (true)
+			{
+				int index_point = rand() % total_points;
+
+				if (find(prohibited_indexes.begin(), prohibited_indexes.end(),
+						 index_point) == prohibited_indexes.end())
+				{
+					prohibited_indexes.push_back(index_point);
+					coreset[index_point].setCluster(i);
+					for (int j = 0; j < total_values; j++)
+						centroids[(size_t)i * total_values + j] = coreset[index_point].getValue(j);
+					break;
+				}
+			}
+		}
+
+		int iter = 1;
+
+		while (true)
+		{
+			// associates each point to the nearest center, weighting its cost
+			int changed = 0;
+			double inertia = 0.0;
+
+			#pragma omp parallel for reduction(+:changed, inertia) schedule(static)
+			for (int i = 0; i < total_points; i++)
+			{
+				double dist;
+				int id_nearest_center = getIDNearestCenter(coreset[i], dist);
+				inertia += coreset[i].getWeight() * dist;
+
+				if (coreset[i].getCluster() != id_nearest_center)
+				{
+					coreset[i].setCluster(id_nearest_center);
+					changed = 1;
+				}
+			}
+			coreset_inertia = inertia;
+
+			// recalculating the center of each cluster as the weighted mean of its points
+			vector<double> cluster_values((size_t)K * total_values, 0.0);
+			vector<double> cluster_weights(K, 0.0);
+
+			for (int i = 0; i < total_points; i++)
+			{
+				int c = coreset[i].getCluster();
+				double w = coreset[i].getWeight();
+				for (int j = 0; j < total_values; j++)
+					cluster_values[(size_t)c * total_values + j] += w * coreset[i].getValue(j);
+				cluster_weights[c] += w;
+			}
+
+			for (int c = 0; c < K; c++)
+			{
+				if (cluster_weights[c] > 0.0)
+				{
+					for (int j = 0; j < total_values; j++)
+						centroids[(size_t)c * total_values + j] =
+							cluster_values[(size_t)c * total_values + j] / cluster_weights[c];
+				}
+			}
+
+			if (changed == 0 || iter >= max_iterations)
+				break;
+
+			iter++;
+		}
+
+		// one assignment pass over the original points
+		if (FULL_ASSIGNMENT)
+		{
+			double inertia = 0.0;
+
+			#pragma omp parallel for reduction(+:inertia) schedule(static)
+			for (size_t i = 0; i < points.size(); i++)
+			{
+				double dist;
+				points[i].setCluster(getIDNearestCenter(points[i], dist));
+				inertia += dist;
+			}
+			full_inertia = inertia;
+		}
+
+		auto end = chrono::high_resolution_clock::now();
+		long long duration = duration_cast<microseconds>(end - begin).count();
+		completed = true;
+
+		return duration;
+	}
+};
+
+int main(int argc, char *argv[])
+{
+	srand(10);
+
+	int total_points, total_values, K, max_iterations, has_name;
+
+	cin >> total_points >> total_values >> K >> max_iterations >> has_name;
+
+	vector<Point> points;
+	string point_name;
+
+	for (int i = 0; i < total_points; i++)
+	{
+		vector<double> values;
+
+		for (int j = 0; j < total_values; j++)
+		{
+			double value;
+			cin >> value;
+			values.push_back(value);
+		}
+
+		if (has_name)
+		{
+			cin >> point_name;
+			Point p(i, values, point_name);
+			points.push_back(p);
+		}
+		else
+		{
+			Point p(i, values);
+			points.push_back(p);
+		}
+	}
+
+	// the sampling hash uses a fixed seed, so every K and run clusters the same sample
+	int coreset_size = min(total_points, max(CORESET_MIN_SIZE, (int)(CORESET_FRACTION * total_points)));
+	auto build_begin = chrono::high_resolution_clock::now();
+	vector<Point> coreset = buildCoreset(points, total_values, coreset_size);
+	auto build_end = chrono::high_resolution_clock::now();
+	cout << "CORESET BUILD TIME = " << duration_cast<microseconds>(build_end - build_begin).count()
+		 << " (" << coreset.size() << " of " << total_points << " points)" << endl;
+
+#ifdef CORESET_OUTPUT
+	if (!writeCoreset(CORESET_OUTPUT, coreset, total_values, K, max_iterations, has_name))
+		cerr << "Could not write the coreset to " << CORESET_OUTPUT << endl;
+#endif
+
+	// runs that could not seed K clusters are left out of the inertia averages,
+	// which are nan when no run completed
+	cout << "K,AverageTimeMicroseconds,CoresetInertia,FullInertia" << endl;
+	int k_vals[] = {2, 3, 5, 10, 20};
+	for (int K : k_vals) {
+		// a sample smaller than K cannot seed K clusters, so it falls back to all the points
+		const vector<Point> &sample = ((int)coreset.size() < K) ? points : coreset;
+
+		long long total_time = 0;
+		double total_coreset = 0.0, total_full = 0.0;
+		int numRuns = 25, completed_runs = 0;
+		for (int r = 0; r < numRuns; r++) {
+			vector<Point> sample_copy = sample;
+			KMeans kmeans(K, total_values, max_iterations);
+			total_time += kmeans.run(sample_copy, points);
+			if (kmeans.hasCompleted()) {
+				total_coreset += kmeans.getCoresetInertia();
+				total_full += kmeans.getFullInertia();
+				completed_runs++;
+			}
+		}
+		long long avg_time = total_time / numRuns;
+		cout << K << "," << avg_time << ",";
+		if (completed_runs > 0)
+			cout << total_coreset / completed_runs << "," << total_full / completed_runs << endl;
+		else
+			cout << "nan,nan" << endl;
+	}
+
+	return 0;
+}
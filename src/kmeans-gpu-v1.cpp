@@ -5,8 +5,16 @@
 #include <assert.h>
 #include <stdint.h>
 #include <chrono>
+#include <math.h>
 #include <kmcuda.h>
 
+// build with -DCOSINE_METRIC for angular distance; KM-CUDA expects normalised rows for it
+#ifdef COSINE_METRIC
+#define DISTANCE_METRIC kmcudaDistanceMetricCosine
+#else
+#define DISTANCE_METRIC kmcudaDistanceMetricL2
+#endif
+
 using namespace std;
 using namespace std::chrono;
 
@@ -33,6 +41,19 @@ int main(int argc, char *argv[])
             cin >> point_name;
             names.push_back(point_name);
         }
+
+#ifdef COSINE_METRIC
+        float norm = 0.0f;
+        for (int j = 0; j < total_values; j++)
+        {
+            norm += data[i * total_values + j] * data[i * total_values + j];
+        }
+        norm = sqrtf(norm);
+        for (int j = 0; norm > 0.0f && j < total_values; j++)
+        {
+            data[i * total_values + j] /= norm;
+        }
+#endif
     }
 
     cout << "K,AverageTimeMicroseconds" << endl;
@@ -57,7 +78,7 @@ int main(int argc, char *argv[])
                 NULL,                       // No predefined centroids
                 0.01,                        // Convergence threshold
                 0.1,                         // Yinyang refinement threshold
-                kmcudaDistanceMetricL2,      // Use Euclidean distance
+                DISTANCE_METRIC,             // Euclidean or cosine distance
                 total_points, total_values, K,
                 0xDEADBEEF,                  // Random seed
                 0,                           // Use all available CUDA devices
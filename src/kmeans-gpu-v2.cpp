@@ -9,10 +9,18 @@
 #include <algorithm>
 #include <chrono>
 #include <sstream>
+#include "result_writer.h"
 #ifdef _OPENACC
 #include <openacc.h>
 #endif
 
+// with DETERMINISTIC_REDUCTION defined, the centroid sums are accumulated in fixed blocks of
+// REDUCTION_BLOCK points and combined in block order, so the centroids are bitwise identical
+// for any number of threads or gangs
+#ifndef REDUCTION_BLOCK
+#define REDUCTION_BLOCK 4096
+#endif
+
 using namespace std;
 using namespace std::chrono;
 
@@ -22,10 +30,11 @@ private:
 	int id_point, id_cluster;
 	vector<double> values;
 	int total_values;
+	double weight;
 	string name;
 
 public:
-	Point(int id_point, vector<double> &values, string name = "")
+	Point(int id_point, vector<double> &values, string name = "", double weight = 1.0)
 	{
 		this->id_point = id_point;
 		total_values = values.size();
@@ -34,6 +43,7 @@ public:
 			this->values.push_back(values[i]);
 
 		this->name = name;
+		this->weight = weight;
 		id_cluster = -1;
 	}
 
@@ -67,6 +77,11 @@ public:
 		values.push_back(value);
 	}
 
+	double getWeight() const
+	{
+		return weight;
+	}
+
 	string getName() const
 	{
 		return name;
@@ -112,6 +127,7 @@ private:
 	int K;
 	int total_values, total_points, max_iterations;
 	vector<Cluster> clusters;
+	long long total_time, phase1_time;
 
 	// return ID of nearest center
 	int getIDNearestCenter(const Point &point)
@@ -183,6 +199,17 @@ public:
 		}
 		auto end_phase1 = chrono::high_resolution_clock::now();
 
+#ifdef DETERMINISTIC_REDUCTION
+		// per-block partial sums, allocated once and cleared every iteration
+		int total_blocks = (total_points + REDUCTION_BLOCK - 1) / REDUCTION_BLOCK;
+		vector<double> block_values((size_t)total_blocks * K * total_values);
+#ifdef WEIGHTED_POINTS
+		vector<double> block_points((size_t)total_blocks * K);
+#else
+		vector<int> block_points((size_t)total_blocks * K);
+#endif
+#endif
+
 		int iter = 1;
 
 		while (true)
@@ -205,20 +232,79 @@ public:
 
 			// recalculating the center of each cluster
 			vector<vector<double>> cluster_values(K, vector<double>(total_values, 0.0));
+#ifdef WEIGHTED_POINTS
+			vector<double> cluster_points(K, 0.0);  // total weight of each cluster
+#else
 			vector<int> cluster_points(K, 0);
+#endif
+
+#ifdef DETERMINISTIC_REDUCTION
+			fill(block_values.begin(), block_values.end(), 0.0);
+			fill(block_points.begin(), block_points.end(), 0);
+
+			// each block sums its points sequentially, in point order
+			#pragma acc parallel loop
+			for (int b = 0; b < total_blocks; b++) {
+				int block_end = min(total_points, (b + 1) * REDUCTION_BLOCK);
+				for (int i = b * REDUCTION_BLOCK; i < block_end; i++) {
+					int c = points[i].getCluster();
+					if (c >= 0 && c < K) {
+#ifdef WEIGHTED_POINTS
+						double w = points[i].getWeight();
+						for (int j = 0; j < total_values; j++) {
+							block_values[((size_t)b * K + c) * total_values + j] += w * points[i].getValue(j);
+						}
+						block_points[(size_t)b * K + c] += w;
+#else
+						for (int j = 0; j < total_values; j++) {
+							block_values[((size_t)b * K + c) * total_values + j] += points[i].getValue(j);
+						}
+						block_points[(size_t)b * K + c]++;
+#endif
+					}
+				}
+			}
 
+			// the partial sums are combined in block order
+			#pragma acc parallel loop collapse(2)
+			for (int c = 0; c < K; c++) {
+				for (int j = 0; j < total_values; j++) {
+					double sum = 0.0;
+					for (int b = 0; b < total_blocks; b++) {
+						sum += block_values[((size_t)b * K + c) * total_values + j];
+					}
+					cluster_values[c][j] = sum;
+				}
+			}
+			for (int c = 0; c < K; c++) {
+				for (int b = 0; b < total_blocks; b++) {
+					cluster_points[c] += block_points[(size_t)b * K + c];
+				}
+			}
+#else
 			#pragma acc parallel loop
             for (int i = 0; i < total_points; i++) {
                 int c = points[i].getCluster();
                 if (c >= 0 && c < K) {
+#ifdef WEIGHTED_POINTS
+                    double w = points[i].getWeight();
+                    for (int j = 0; j < total_values; j++) {
+                        #pragma acc atomic
+                        cluster_values[c][j] += w * points[i].getValue(j);
+                    }
+                    #pragma acc atomic
+                    cluster_points[c] += w;
+#else
                     for (int j = 0; j < total_values; j++) {
                         #pragma acc atomic
                         cluster_values[c][j] += points[i].getValue(j);
                     }
                     #pragma acc atomic
                     cluster_points[c]++;
+#endif
                 }
             }
+#endif
 
 			#pragma acc parallel loop
             for (int c = 0; c < K; c++) {
@@ -240,48 +326,31 @@ public:
 		auto end = chrono::high_resolution_clock::now();
 		long long duration = duration_cast<microseconds>(end - begin).count();
 
-		cout << "--------------------------------------------------" << endl;
-		// shows elements of clusters
-		vector<vector<const Point*>> cluster_points(K);
-		for (int i = 0; i < total_points; i++) {
-			int c = points[i].getCluster();
-			if (c >= 0 && c < K) {
-				cluster_points[c].push_back(&points[i]);
-			}
-		}
-	
-		for (int c = 0; c < K; c++) {
-			cout << "Cluster " << c + 1 << endl;
-	
-			for (const Point* pt : cluster_points[c]) {
-				cout << "Point " << pt->getID() + 1 << ": ";
-				for (int j = 0; j < total_values; j++) {
-					cout << pt->getValue(j) << " ";
-				}
-				string name = pt->getName();
-	
-				if (!name.empty())
-					cout << "- " << name;
-				cout << endl;
-			}
-	
-			cout << "Cluster values: ";
-	
-			for (int j = 0; j < total_values; j++) {
-				cout << clusters[c].getCentralValue(j) << " ";
-			}
-			cout << "\n\n";
-			cout << "TOTAL EXECUTION TIME = " << std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() << "\n";
-	
-			cout << "TIME PHASE 1 = " << std::chrono::duration_cast<std::chrono::microseconds>(end_phase1 - begin).count() << "\n";
-	
-			cout << "TIME PHASE 2 = " << std::chrono::duration_cast<std::chrono::microseconds>(end - end_phase1).count() << "\n";
-		}
-		cout << "--------------------------------------------------" << endl;
+		total_time = duration;
+		phase1_time = duration_cast<microseconds>(end_phase1 - begin).count();
 
 		return duration;
 		// return iter;
 	}
+
+	// collects the assignments and centroids of the last run for the result writer
+	RunResult getResult(const vector<Point> &points, int run) const
+	{
+		RunResult result;
+		result.K = K;
+		result.run = run;
+		result.total_time = total_time;
+		result.phase1_time = phase1_time;
+
+		for (int i = 0; i < total_points; i++)
+			result.assignments.push_back(points[i].getCluster());
+
+		for (size_t c = 0; c < clusters.size(); c++)
+			for (int j = 0; j < total_values; j++)
+				result.centroids.push_back(clusters[c].getCentralValue(j));
+
+		return result;
+	}
 };
 
 int main(int argc, char *argv[])
@@ -306,19 +375,40 @@ int main(int argc, char *argv[])
 			values.push_back(value);
 		}
 
+		// weighted builds read each point's weight right after its values; each centroid is
+		// then the weighted mean of its points (kmeans-coreset writes its sample this way)
+		double weight = 1.0;
+#ifdef WEIGHTED_POINTS
+		cin >> weight;
+#endif
+
 		if (has_name)
 		{
 			cin >> point_name;
-			Point p(i, values, point_name);
+			Point p(i, values, point_name, weight);
 			points.push_back(p);
 		}
 		else
 		{
-			Point p(i, values);
+			Point p(i, values, "", weight);
 			points.push_back(p);
 		}
 	}
 
+	vector<double> values, weights;
+	vector<string> names;
+	for (int i = 0; i < total_points; i++)
+	{
+		for (int j = 0; j < total_values; j++)
+			values.push_back(points[i].getValue(j));
+		weights.push_back(points[i].getWeight());
+		names.push_back(points[i].getName());
+	}
+	ResultWriter writer(total_points, total_values, std::move(values), std::move(names));
+#ifdef WEIGHTED_POINTS
+	writer.setWeights(std::move(weights));
+#endif
+
 	cout << "K,AverageTimeMicroseconds" << endl;
     int k_vals[] = {2, 3, 5, 10, 20};
     for (int K : k_vals) {
@@ -328,7 +418,9 @@ int main(int argc, char *argv[])
             vector<Point> points_copy = points;
             KMeans kmeans(K, total_points, total_values, max_iterations);
             total_time += kmeans.run(points_copy);
+            writer.submit(kmeans.getResult(points_copy, r));
         }
+        writer.finishK();
         long long avg_time = total_time / numRuns;
         cout << K << "," << avg_time << endl;
     }
@@ -2,7 +2,22 @@
 #include <cstdlib>
 #include <cmath>
 #include <chrono>
+#include <utility>
 #include <cuda_runtime.h>
+#include "result_writer.h"
+
+// every REORDER_INTERVAL iterations the points are permuted so that the points of
+// each cluster are contiguous; 0 disables the reordering
+#ifndef REORDER_INTERVAL
+#define REORDER_INTERVAL 0
+#endif
+
+// with DETERMINISTIC_REDUCTION defined, the points are split into REDUCTION_CHUNKS_PER_SM chunks
+// per multiprocessor; each chunk is summed in point order and the chunks are combined in chunk
+// order instead of with atomicAdd, so the centroids are bitwise identical from run to run
+#ifndef REDUCTION_CHUNKS_PER_SM
+#define REDUCTION_CHUNKS_PER_SM 4
+#endif
 
 using namespace std;
 using namespace std::chrono;
@@ -24,7 +39,10 @@ __global__ void assignClusters(
     int total_points,
     int K,
     int total_values,
-    int *changed_flag
+    int *changed_flag,
+    const int *home,
+    int *movers,
+    int *mover_count
 ) {
     int idx = threadIdx.x + blockDim.x * blockIdx.x;
     if (idx >= total_points) return;
@@ -48,6 +66,23 @@ __global__ void assignClusters(
         assignments[idx] = best_cluster;
         atomicExch(changed_flag, 1);
     }
+
+    // points that left the segment of their cluster are handled separately by the update;
+    // home is NULL until the first reorder, when there are no segments yet
+    if (home != NULL && home[idx] != best_cluster) {
+        movers[atomicAdd(mover_count, 1)] = idx;
+    }
+}
+
+__device__ void accumulatePoint(
+    double *point_values,
+    double *shared_sums,
+    int i,
+    int total_values
+) {
+    for (int j = 0; j < total_values; j++) {
+        atomicAdd(&shared_sums[j], point_values[i * total_values + j]);
+    }
 }
 
 __global__ void updateCentroids(
@@ -57,7 +92,10 @@ __global__ void updateCentroids(
     int *cluster_sizes,
     int total_points,
     int K,
-    int total_values
+    int total_values,
+    const int *segment_offsets,
+    const int *movers,
+    const int *mover_count
 ) {
     int c = blockIdx.x;
     if (c >= K) return;
@@ -70,12 +108,48 @@ __global__ void updateCentroids(
     __syncthreads();
 
     int local_count = 0;
-    for (int i = threadIdx.x; i < total_points; i += blockDim.x) {
-        if (assignments[i] == c) {
-            local_count++;
-            for (int j = 0; j < total_values; j++) {
-                atomicAdd(&shared_sums[j], point_values[i * total_values + j]);
+    if (segment_offsets == NULL) {
+        for (int i = threadIdx.x; i < total_points; i += blockDim.x) {
+            if (assignments[i] == c) {
+                local_count++;
+                accumulatePoint(point_values, shared_sums, i, total_values);
+            }
+        }
+    } else {
+        // points are grouped by cluster: scan only this cluster's segment and the movers, and
+        // sum each dimension with a tree reduction instead of atomics on the same shared sum
+        double *partial = shared_sums + total_values;
+        int segment_begin = segment_offsets[c], segment_end = segment_offsets[c + 1];
+        int total_movers = *mover_count;
+
+        for (int j = 0; j < total_values; j++) {
+            double sum = 0.0;
+            for (int i = segment_begin + threadIdx.x; i < segment_end; i += blockDim.x) {
+                if (assignments[i] == c) {
+                    sum += point_values[i * total_values + j];
+                    if (j == 0) local_count++;
+                }
+            }
+            for (int m = threadIdx.x; m < total_movers; m += blockDim.x) {
+                int i = movers[m];
+                if (assignments[i] == c) {
+                    sum += point_values[i * total_values + j];
+                    if (j == 0) local_count++;
+                }
+            }
+
+            partial[threadIdx.x] = sum;
+            __syncthreads();
+            for (int stride = blockDim.x / 2; stride > 0; stride /= 2) {
+                if (threadIdx.x < stride) {
+                    partial[threadIdx.x] += partial[threadIdx.x + stride];
+                }
+                __syncthreads();
             }
+            if (threadIdx.x == 0) {
+                shared_sums[j] = partial[0];
+            }
+            __syncthreads();
         }
     }
 
@@ -96,6 +170,147 @@ __global__ void updateCentroids(
     }
 }
 
+// one block per chunk of points; thread j sums dimension j over the chunk, in point order
+__global__ void partialCentroidSums(
+    double *point_values,
+    double *partial_sums,
+    int *partial_counts,
+    int *assignments,
+    int total_points,
+    int chunk_size,
+    int K,
+    int total_values
+) {
+    int chunk = blockIdx.x;
+    int chunk_begin = chunk * chunk_size;
+    int chunk_end = min(total_points, chunk_begin + chunk_size);
+
+    for (int i = chunk_begin; i < chunk_end; i++) {
+        int c = assignments[i];
+        for (int j = threadIdx.x; j < total_values; j += blockDim.x) {
+            partial_sums[((size_t)chunk * K + c) * total_values + j] += point_values[(size_t)i * total_values + j];
+        }
+        if (threadIdx.x == 0) {
+            partial_counts[chunk * K + c]++;
+        }
+    }
+}
+
+// one block per cluster; the partial sums are combined in chunk order
+__global__ void reduceCentroidSums(
+    double *cluster_values,
+    double *partial_sums,
+    int *partial_counts,
+    int *cluster_sizes,
+    int total_chunks,
+    int K,
+    int total_values
+) {
+    int c = blockIdx.x;
+    if (c >= K) return;
+
+    int count = 0;
+    for (int chunk = 0; chunk < total_chunks; chunk++) {
+        count += partial_counts[chunk * K + c];
+    }
+
+    for (int j = threadIdx.x; j < total_values; j += blockDim.x) {
+        double sum = 0.0;
+        for (int chunk = 0; chunk < total_chunks; chunk++) {
+            sum += partial_sums[((size_t)chunk * K + c) * total_values + j];
+        }
+        cluster_values[c * total_values + j] = (count > 0) ? sum / count : 0.0;
+    }
+
+    if (threadIdx.x == 0) {
+        cluster_sizes[c] = count;
+    }
+}
+
+__global__ void permutePoints(
+    const double *point_values,
+    double *permuted_values,
+    const int *assignments,
+    int *permuted_assignments,
+    int *home,
+    const int *order,
+    int total_points,
+    int total_values
+) {
+    int idx = threadIdx.x + blockDim.x * blockIdx.x;
+    if (idx >= total_points) return;
+
+    int src = order[idx];
+    for (int j = 0; j < total_values; j++) {
+        permuted_values[idx * total_values + j] = point_values[src * total_values + j];
+    }
+    permuted_assignments[idx] = assignments[src];
+    home[idx] = assignments[src];
+}
+
+// groups the points by cluster on the device; perm tracks the original index of each position
+void reorderPoints(
+    double *&d_point_values,
+    double *&d_point_scratch,
+    int *&d_assignments,
+    int *&d_assignments_scratch,
+    int *d_home,
+    int *d_order,
+    int *d_segment_offsets,
+    int *h_perm,
+    int total_points,
+    int K,
+    int total_values
+) {
+    int *h_assignments = new int[total_points];
+    int *h_order = new int[total_points];
+    int *h_perm_old = new int[total_points];
+    int *h_offsets = new int[K + 1]();
+
+    cudaMemcpy(h_assignments, d_assignments, total_points * sizeof(int), cudaMemcpyDeviceToHost);
+
+    // counting sort of the positions by cluster
+    for (int i = 0; i < total_points; i++) {
+        h_offsets[h_assignments[i] + 1]++;
+    }
+    for (int c = 0; c < K; c++) {
+        h_offsets[c + 1] += h_offsets[c];
+    }
+    int *next = new int[K];
+    for (int c = 0; c < K; c++) {
+        next[c] = h_offsets[c];
+    }
+    for (int i = 0; i < total_points; i++) {
+        h_order[next[h_assignments[i]]++] = i;
+    }
+    for (int i = 0; i < total_points; i++) {
+        h_perm_old[i] = h_perm[i];
+    }
+    for (int i = 0; i < total_points; i++) {
+        h_perm[i] = h_perm_old[h_order[i]];
+    }
+
+    cudaMemcpy(d_order, h_order, total_points * sizeof(int), cudaMemcpyHostToDevice);
+    cudaMemcpy(d_segment_offsets, h_offsets, (K + 1) * sizeof(int), cudaMemcpyHostToDevice);
+
+    int threads = 256;
+    int blocks_points = (total_points + threads - 1) / threads;
+    permutePoints<<<blocks_points, threads>>>(d_point_values, d_point_scratch, d_assignments,
+                                              d_assignments_scratch, d_home, d_order,
+                                              total_points, total_values);
+    cudaGetLastError();
+    cudaDeviceSynchronize();
+
+    swap(d_point_values, d_point_scratch);
+    swap(d_assignments, d_assignments_scratch);
+
+    delete[] h_assignments;
+    delete[] h_order;
+    delete[] h_perm_old;
+    delete[] h_offsets;
+    delete[] next;
+}
+
 long long kmeansCUDA(Point *h_points, Cluster *h_clusters, int total_points, int K, int total_values, int max_iterations) {
     auto begin = high_resolution_clock::now();
 
@@ -108,6 +323,40 @@ long long kmeansCUDA(Point *h_points, Cluster *h_clusters, int total_points, int
     cudaMalloc(&d_cluster_sizes, K * sizeof(int));
     cudaMalloc(&d_changed_flag, sizeof(int));
 
+#ifdef DETERMINISTIC_REDUCTION
+    // a fixed number of chunks per multiprocessor keeps the partial sums small at any N
+    int total_sms = 1;
+    cudaDeviceGetAttribute(&total_sms, cudaDevAttrMultiProcessorCount, 0);
+    int total_chunks = min(total_points, max(1, total_sms * REDUCTION_CHUNKS_PER_SM));
+    int chunk_size = (total_points + total_chunks - 1) / total_chunks;
+    size_t partial_sums_bytes = (size_t)total_chunks * K * total_values * sizeof(double);
+    size_t partial_counts_bytes = (size_t)total_chunks * K * sizeof(int);
+    double *d_partial_sums;
+    int *d_partial_counts;
+    cudaMalloc(&d_partial_sums, partial_sums_bytes);
+    cudaMalloc(&d_partial_counts, partial_counts_bytes);
+#endif
+
+    // buffers for the periodic reordering; left NULL when it is disabled
+    double *d_point_scratch = NULL;
+    int *d_assignments_scratch = NULL, *d_home = NULL, *d_order = NULL, *d_segment_offsets = NULL;
+    int *d_movers = NULL, *d_mover_count = NULL;
+    int *h_perm = new int[total_points];
+    for (int i = 0; i < total_points; i++) {
+        h_perm[i] = i;
+    }
+    if (REORDER_INTERVAL > 0) {
+        cudaMalloc(&d_point_scratch, total_points * total_values * sizeof(double));
+        cudaMalloc(&d_assignments_scratch, total_points * sizeof(int));
+        cudaMalloc(&d_home, total_points * sizeof(int));
+        cudaMalloc(&d_order, total_points * sizeof(int));
+        cudaMalloc(&d_segment_offsets, (K + 1) * sizeof(int));
+        cudaMalloc(&d_movers, total_points * sizeof(int));
+        cudaMalloc(&d_mover_count, sizeof(int));
+    }
+    // the movers and segments are only used once the points have been reordered
+    bool reordered = false;
+
     // copies points into device memory
     for (int i = 0; i < total_points; i++) {
         cudaMemcpy(d_point_values + i * total_values,
@@ -136,31 +385,61 @@ long long kmeansCUDA(Point *h_points, Cluster *h_clusters, int total_points, int
         iter++;
         h_changed_flag = 0;
         cudaMemset(d_changed_flag, 0, sizeof(int));
+        if (reordered) {
+            cudaMemset(d_mover_count, 0, sizeof(int));
+        }
 
         assignClusters<<<blocks_points, threads>>>(d_point_values, d_cluster_values, d_assignments,
-                                                     total_points, K, total_values, d_changed_flag);
+                                                     total_points, K, total_values, d_changed_flag,
+                                                     reordered ? d_home : NULL, d_movers, d_mover_count);
         cudaGetLastError();
         cudaDeviceSynchronize();
 
         cudaMemcpy(&h_changed_flag, d_changed_flag, sizeof(int), cudaMemcpyDeviceToHost);
 
+        if (REORDER_INTERVAL > 0 && h_changed_flag && iter % REORDER_INTERVAL == 0) {
+            reorderPoints(d_point_values, d_point_scratch, d_assignments, d_assignments_scratch,
+                          d_home, d_order, d_segment_offsets, h_perm, total_points, K, total_values);
+            // every point now sits in the segment of its cluster
+            cudaMemset(d_mover_count, 0, sizeof(int));
+            reordered = true;
+        }
+
+#ifdef DETERMINISTIC_REDUCTION
+        cudaMemset(d_partial_sums, 0, partial_sums_bytes);
+        cudaMemset(d_partial_counts, 0, partial_counts_bytes);
+
+        int threads_dims = min(threads, (total_values + 31) / 32 * 32);
+        partialCentroidSums<<<total_chunks, threads_dims>>>(d_point_values, d_partial_sums, d_partial_counts,
+                                                            d_assignments, total_points, chunk_size, K, total_values);
+        cudaGetLastError();
+        reduceCentroidSums<<<K, threads_dims>>>(d_cluster_values, d_partial_sums, d_partial_counts,
+                                                d_cluster_sizes, total_chunks, K, total_values);
+        cudaGetLastError();
+        cudaDeviceSynchronize();
+#else
         cudaMemset(d_cluster_sizes, 0, K * sizeof(int));
 
-        updateCentroids<<<K, threads, total_values * sizeof(double)>>>(d_point_values, d_cluster_values,
-                                                                         d_assignments, d_cluster_sizes,
-                                                                         total_points, K, total_values);
+        // the segmented path also needs one double per thread for its reductions
+        size_t shared_bytes = (total_values + (reordered ? threads : 0)) * sizeof(double);
+        updateCentroids<<<K, threads, shared_bytes>>>(
+            d_point_values, d_cluster_values, d_assignments, d_cluster_sizes, total_points, K, total_values,
+            reordered ? d_segment_offsets : NULL, d_movers, d_mover_count);
         cudaGetLastError();
         cudaDeviceSynchronize();
+#endif
     } while (h_changed_flag && iter < max_iterations);
 
     auto end = high_resolution_clock::now();
 
     int *assignments_host = new int[total_points];
     cudaMemcpy(assignments_host, d_assignments, total_points * sizeof(int), cudaMemcpyDeviceToHost);
+    // reports the assignments in the original order of the points
     for (int i = 0; i < total_points; i++) {
-        h_points[i].id_cluster = assignments_host[i];
+        h_points[h_perm[i]].id_cluster = assignments_host[i];
     }
     delete[] assignments_host;
+    delete[] h_perm;
 
     for (int i = 0; i < K; i++) {
         cudaMemcpy(h_clusters[i].central_values,
@@ -199,6 +478,17 @@ long long kmeansCUDA(Point *h_points, Cluster *h_clusters, int total_points, int
     cudaFree(d_assignments);
     cudaFree(d_cluster_sizes);
     cudaFree(d_changed_flag);
+    cudaFree(d_point_scratch);
+    cudaFree(d_assignments_scratch);
+    cudaFree(d_home);
+    cudaFree(d_order);
+    cudaFree(d_segment_offsets);
+    cudaFree(d_movers);
+    cudaFree(d_mover_count);
+#ifdef DETERMINISTIC_REDUCTION
+    cudaFree(d_partial_sums);
+    cudaFree(d_partial_counts);
+#endif
 
     return duration;
 }
@@ -221,6 +511,16 @@ int main(int argc, char *argv[]) {
         points[i].id_cluster = -1;
     }
 
+    vector<double> values;
+    vector<string> names;
+    for (int i = 0; i < total_points; i++) {
+        for (int j = 0; j < total_values; j++) {
+            values.push_back(points[i].values[j]);
+        }
+        names.push_back(points[i].name);
+    }
+    ResultWriter writer(total_points, total_values, std::move(values), std::move(names));
+
     cout << "K,AverageTimeMicroseconds" << endl;
 
     int k_vals[] = {2, 3, 5, 10, 20};
@@ -258,11 +558,27 @@ int main(int argc, char *argv[]) {
             long long run_time = kmeansCUDA(points, clusters, total_points, k_val, total_values, max_iterations);
             total_time += run_time;
 
+            RunResult result;
+            result.K = k_val;
+            result.run = r;
+            result.total_time = run_time;
+            result.phase1_time = 0;
+            for (int i = 0; i < total_points; i++) {
+                result.assignments.push_back(points[i].id_cluster);
+            }
+            for (int i = 0; i < k_val; i++) {
+                for (int j = 0; j < total_values; j++) {
+                    result.centroids.push_back(clusters[i].central_values[j]);
+                }
+            }
+            writer.submit(std::move(result));
+
             for (int i = 0; i < k_val; i++) {
                 delete[] clusters[i].central_values;
             }
             delete[] clusters;
         }
+        writer.finishK();
         long long avg_time = total_time / num_runs;
         cout << k_val << "," << avg_time << endl;
     }
@@ -0,0 +1,499 @@
+// Implementation of the KMeans Algorithm using the filtering algorithm over a kd-tree
+// reference: Kanungo et al., "An Efficient k-Means Clustering Algorithm: Analysis and Implementation"
+
+#include <iostream>
+#include <vector>
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// maximum number of points stored in a leaf of the tree
+#ifndef LEAF_SIZE
+#define LEAF_SIZE 16
+#endif
+
+// nodes above this depth are built and filtered as separate OpenMP tasks
+#ifndef TASK_DEPTH
+#define TASK_DEPTH 6
+#endif
+
+using namespace std;
+using namespace std::chrono;
+
+class Point
+{
+private:
+	int id_point, id_cluster;
+	vector<double> values;
+	int total_values;
+	string name;
+
+public:
+	Point(int id_point, vector<double> &values, string name = "")
+	{
+		this->id_point = id_point;
+		total_values = values.size();
+
+		for (int i = 0; i < total_values; i++)
+			this->values.push_back(values[i]);
+
+		this->name = name;
+		id_cluster = -1;
+	}
+
+	int getID() const
+	{
+		return id_point;
+	}
+
+	void setCluster(int id_cluster)
+	{
+		this->id_cluster = id_cluster;
+	}
+
+	int getCluster() const
+	{
+		return id_cluster;
+	}
+
+	double getValue(int index) const
+	{
+		return values[index];
+	}
+
+	int getTotalValues() const
+	{
+		return total_values;
+	}
+
+	string getName() const
+	{
+		return name;
+	}
+};
+
+struct KDNode
+{
+	int begin, end;             // range of tree positions covered by the node
+	vector<double> min_values;  // bounding box of the cell
+	vector<double> max_values;
+	vector<double> sum_values;  // sum of all points in the cell
+	KDNode *left, *right;       // both NULL for leaves
+};
+
+// kd-tree over the points, built once and shared by every run and every K
+class KDTree
+{
+private:
+	int total_values, total_points;
+	vector<double> values;  // point values, stored in tree order
+	vector<int> ids;        // original index of the point at each tree position
+	KDNode *root;
+
+	KDNode *build(int begin, int end, int depth)
+	{
+		KDNode *node = new KDNode;
+		node->begin = begin;
+		node->end = end;
+		node->left = node->right = NULL;
+		node->min_values.assign(total_values, INFINITY);
+		node->max_values.assign(total_values, -INFINITY);
+		node->sum_values.assign(total_values, 0.0);
+
+		for (int i = begin; i < end; i++) {
+			const double *p = &values[(size_t)ids[i] * total_values];
+			for (int j = 0; j < total_values; j++) {
+				node->min_values[j] = min(node->min_values[j], p[j]);
+				node->max_values[j] = max(node->max_values[j], p[j]);
+			}
+		}
+
+		int split_dim = 0;
+		for (int j = 1; j < total_values; j++) {
+			if (node->max_values[j] - node->min_values[j] >
+				node->max_values[split_dim] - node->min_values[split_dim])
+				split_dim = j;
+		}
+
+		if (end - begin <= LEAF_SIZE ||
+			node->max_values[split_dim] == node->min_values[split_dim]) {
+			for (int i = begin; i < end; i++) {
+				const double *p = &values[(size_t)ids[i] * total_values];
+				for (int j = 0; j < total_values; j++)
+					node->sum_values[j] += p[j];
+			}
+			return node;
+		}
+
+		// split at the median of the widest dimension
+		int mid = begin + (end - begin) / 2;
+		nth_element(ids.begin() + begin, ids.begin() + mid, ids.begin() + end,
+					[&](int a, int b) {
+						return values[(size_t)a * total_values + split_dim] <
+							   values[(size_t)b * total_values + split_dim];
+					});
+
+		#pragma omp task shared(node) if (depth < TASK_DEPTH)
+		node->left = build(begin, mid, depth + 1);
+		#pragma omp task shared(node) if (depth < TASK_DEPTH)
+		node->right = build(mid, end, depth + 1);
+		#pragma omp taskwait
+
+		for (int j = 0; j < total_values; j++)
+			node->sum_values[j] = node->left->sum_values[j] + node->right->sum_values[j];
+
+		return node;
+	}
+
+	void destroy(KDNode *node)
+	{
+		if (node == NULL)
+			return;
+		destroy(node->left);
+		destroy(node->right);
+		delete node;
+	}
+
+public:
+	KDTree(const vector<Point> &points, int total_values)
+	{
+		this->total_values = total_values;
+		total_points = points.size();
+
+		ids.resize(total_points);
+		values.resize((size_t)total_points * total_values);
+		for (int i = 0; i < total_points; i++) {
+			ids[i] = i;
+			for (int j = 0; j < total_values; j++)
+				values[(size_t)i * total_values + j] = points[i].getValue(j);
+		}
+
+		#pragma omp parallel
+		#pragma omp single
+		root = build(0, total_points, 0);
+
+		// store the values in tree order so that leaves are contiguous
+		vector<double> ordered((size_t)total_points * total_values);
+		#pragma omp parallel for
+		for (int i = 0; i < total_points; i++) {
+			for (int j = 0; j < total_values; j++)
+				ordered[(size_t)i * total_values + j] = values[(size_t)ids[i] * total_values + j];
+		}
+		values.swap(ordered);
+	}
+
+	~KDTree()
+	{
+		destroy(root);
+	}
+
+	const KDNode *getRoot() const
+	{
+		return root;
+	}
+
+	const double *getValues(int position) const
+	{
+		return &values[(size_t)position * total_values];
+	}
+
+	int getID(int position) const
+	{
+		return ids[position];
+	}
+
+	int getTotalValues() const
+	{
+		return total_values;
+	}
+
+	int getTotalPoints() const
+	{
+		return total_points;
+	}
+};
+
+class KMeans
+{
+private:
+	int K;
+	int total_values, total_points, max_iterations;
+	const KDTree &tree;
+	vector<double> centroids;  // K * total_values
+
+	// per-thread accumulators for the centroid update
+	vector<vector<double>> thread_sums;
+	vector<vector<int>> thread_counts;
+
+	double distance(const double *a, const double *b) const
+	{
+		double sum = 0.0;
+		for (int j = 0; j < total_values; j++) {
+			double diff = a[j] - b[j];
+			sum += diff * diff;
+		}
+		return sum;
+	}
+
+	// true if candidate z is farther than z_star from every point of the cell
+	bool isFarther(int z, int z_star, const KDNode *node) const
+	{
+		const double *cz = &centroids[(size_t)z * total_values];
+		const double *cs = &centroids[(size_t)z_star * total_values];
+		double dz = 0.0, ds = 0.0;
+
+		for (int j = 0; j < total_values; j++) {
+			// vertex of the cell furthest in the direction z - z_star
+			double v = (cz[j] > cs[j]) ? node->max_values[j] : node->min_values[j];
+			dz += (cz[j] - v) * (cz[j] - v);
+			ds += (cs[j] - v) * (cs[j] - v);
+		}
+		return dz >= ds;
+	}
+
+	int nearest(const double *p, const int *candidates, int total_candidates) const
+	{
+		int best = candidates[0];
+		double min_dist = distance(p, &centroids[(size_t)best * total_values]);
+
+		for (int i = 1; i < total_candidates; i++) {
+			double dist = distance(p, &centroids[(size_t)candidates[i] * total_values]);
+			if (dist < min_dist) {
+				min_dist = dist;
+				best = candidates[i];
+			}
+		}
+		return best;
+	}
+
+	// assigns the cell to the candidates, either as a whole or point by point;
+	// when labels is not NULL the assignment of each point is recorded instead
+	void filter(const KDNode *node, const int *candidates, int total_candidates,
+				int depth, vector<int> *labels)
+	{
+		int tid = 0;
+#ifdef _OPENMP
+		tid = omp_get_thread_num();
+#endif
+		vector<double> &sums = thread_sums[tid];
+		vector<int> &counts = thread_counts[tid];
+
+		if (node->left == NULL) {
+			for (int i = node->begin; i < node->end; i++) {
+				const double *p = tree.getValues(i);
+				int c = nearest(p, candidates, total_candidates);
+
+				if (labels != NULL) {
+					(*labels)[tree.getID(i)] = c;
+					continue;
+				}
+				for (int j = 0; j < total_values; j++)
+					sums[(size_t)c * total_values + j] += p[j];
+				counts[c]++;
+			}
+			return;
+		}
+
+		// candidate closest to the midpoint of the cell
+		vector<double> mid(total_values);
+		for (int j = 0; j < total_values; j++)
+			mid[j] = (node->min_values[j] + node->max_values[j]) / 2.0;
+		int z_star = nearest(mid.data(), candidates, total_candidates);
+
+		vector<int> kept;
+		kept.reserve(total_candidates);
+		for (int i = 0; i < total_candidates; i++) {
+			if (candidates[i] == z_star || !isFarther(candidates[i], z_star, node))
+				kept.push_back(candidates[i]);
+		}
+
+		if (kept.size() == 1) {
+			if (labels != NULL) {
+				for (int i = node->begin; i < node->end; i++)
+					(*labels)[tree.getID(i)] = z_star;
+				return;
+			}
+			for (int j = 0; j < total_values; j++)
+				sums[(size_t)z_star * total_values + j] += node->sum_values[j];
+			counts[z_star] += node->end - node->begin;
+			return;
+		}
+
+		#pragma omp task firstprivate(kept) if (depth < TASK_DEPTH)
+		filter(node->left, kept.data(), kept.size(), depth + 1, labels);
+		#pragma omp task firstprivate(kept) if (depth < TASK_DEPTH)
+		filter(node->right, kept.data(), kept.size(), depth + 1, labels);
+		#pragma omp taskwait
+	}
+
+	void traverse(vector<int> *labels)
+	{
+		vector<int> candidates(K);
+		for (int i = 0; i < K; i++)
+			candidates[i] = i;
+
+		#pragma omp parallel
+		#pragma omp single
+		filter(tree.getRoot(), candidates.data(), K, 0, labels);
+	}
+
+public:
+	KMeans(int K, const KDTree &tree, int max_iterations) : tree(tree)
+	{
+		this->K = K;
+		this->total_points = tree.getTotalPoints();
+		this->total_values = tree.getTotalValues();
+		this->max_iterations = max_iterations;
+	}
+
+	long long run(vector<Point> &points)
+	{
+		auto begin = chrono::high_resolution_clock::now();
+
+		if (K > total_points)
+			return 0;
+
+		vector<int> prohibited_indexes;
+		centroids.assign((size_t)K * total_values, 0.0);
+
+		// choose K distinct values for the centers of the clusters
+		for (int i = 0; i < K; i++)
+		{
+			while (true)
+			{
+				int index_point = rand() % total_points;
+
+				if (find(prohibited_indexes.begin(), prohibited_indexes.end(),
+						 index_point) == prohibited_indexes.end())
+				{
+					prohibited_indexes.push_back(index_point);
+					for (int j = 0; j < total_values; j++)
+						centroids[(size_t)i * total_values + j] = points[index_point].getValue(j);
+					break;
+				}
+			}
+		}
+
+		int total_threads = 1;
+#ifdef _OPENMP
+		total_threads = omp_get_max_threads();
+#endif
+		thread_sums.assign(total_threads, vector<double>((size_t)K * total_values));
+		thread_counts.assign(total_threads, vector<int>(K));
+
+		int iter = 1;
+
+		while (true)
+		{
+			for (int t = 0; t < total_threads; t++) {
+				fill(thread_sums[t].begin(), thread_sums[t].end(), 0.0);
+				fill(thread_counts[t].begin(), thread_counts[t].end(), 0);
+			}
+
+			// associates each cell of the tree to the nearest center
+			traverse(NULL);
+
+			// recalculating the center of each cluster
+			bool done = true;
+			for (int c = 0; c < K; c++) {
+				int count = 0;
+				for (int t = 0; t < total_threads; t++)
+					count += thread_counts[t][c];
+				if (count == 0)
+					continue;
+
+				for (int j = 0; j < total_values; j++) {
+					double sum = 0.0;
+					for (int t = 0; t < total_threads; t++)
+						sum += thread_sums[t][(size_t)c * total_values + j];
+
+					double value = sum / count;
+					if (value != centroids[(size_t)c * total_values + j]) {
+						centroids[(size_t)c * total_values + j] = value;
+						done = false;
+					}
+				}
+			}
+
+			if (done || iter >= max_iterations)
+				break;
+
+			iter++;
+		}
+
+		// records the final cluster of every point
+		vector<int> labels(total_points, -1);
+		traverse(&labels);
+		for (int i = 0; i < total_points; i++)
+			points[i].setCluster(labels[i]);
+
+		auto end = chrono::high_resolution_clock::now();
+		long long duration = duration_cast<microseconds>(end - begin).count();
+
+		return duration;
+	}
+};
+
+int main(int argc, char *argv[])
+{
+	srand(10);
+
+	int total_points, total_values, K, max_iterations, has_name;
+
+	cin >> total_points >> total_values >> K >> max_iterations >> has_name;
+
+	vector<Point> points;
+	string point_name;
+
+	for (int i = 0; i < total_points; i++)
+	{
+		vector<double> values;
+
+		for (int j = 0; j < total_values; j++)
+		{
+			double value;
+			cin >> value;
+			values.push_back(value);
+		}
+
+		if (has_name)
+		{
+			cin >> point_name;
+			Point p(i, values, point_name);
+			points.push_back(p);
+		}
+		else
+		{
+			Point p(i, values);
+			points.push_back(p);
+		}
+	}
+
+	// the tree only depends on the points, so it is reused by every run below
+	auto build_begin = chrono::high_resolution_clock::now();
+	KDTree tree(points, total_values);
+	auto build_end = chrono::high_resolution_clock::now();
+	cout << "TREE BUILD TIME = " << duration_cast<microseconds>(build_end - build_begin).count() << endl;
+
+	cout << "K,AverageTimeMicroseconds" << endl;
+	int k_vals[] = {2, 3, 5, 10, 20};
+	for (int K : k_vals) {
+		long long total_time = 0;
+		int numRuns = 25;
+		for (int r = 0; r < numRuns; r++) {
+			vector<Point> points_copy = points;
+			KMeans kmeans(K, tree, max_iterations);
+			total_time += kmeans.run(points_copy);
+		}
+		long long avg_time = total_time / numRuns;
+		cout << K << "," << avg_time << endl;
+	}
+
+	return 0;
+}
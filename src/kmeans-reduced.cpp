@@ -0,0 +1,529 @@
+// Implementation of the KMeans Algorithm on dimensionality-reduced data
+// reference: Halko, Martinsson and Tropp, "Finding Structure with Randomness" (randomized PCA)
+//            Li, Hastie and Church, "Very Sparse Random Projections"
+//
+// The points are projected once to REDUCED_VALUES dimensions, Lloyd runs in the reduced space,
+// and the centroids are then lifted back and refined with a few full-dimension iterations.
+
+#include <iostream>
+#include <vector>
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// 0: randomized PCA, 1: sparse random projection
+#ifndef REDUCTION_METHOD
+#define REDUCTION_METHOD 0
+#endif
+
+// number of dimensions kept by the reduction (capped at the input dimension)
+#ifndef REDUCED_VALUES
+#define REDUCED_VALUES 32
+#endif
+
+// extra random directions and power iterations used by the randomized PCA
+#ifndef OVERSAMPLING
+#define OVERSAMPLING 10
+#endif
+#ifndef POWER_ITERATIONS
+#define POWER_ITERATIONS 2
+#endif
+
+// full-dimension Lloyd iterations run after the reduced solution; 0 disables the refinement
+#ifndef REFINE_ITERATIONS
+#define REFINE_ITERATIONS 3
+#endif
+
+// rows per block in the dense products
+#ifndef BLOCK_ROWS
+#define BLOCK_ROWS 256
+#endif
+
+using namespace std;
+using namespace std::chrono;
+
+// dense row-major matrix
+struct Matrix
+{
+	int rows, cols;
+	vector<double> values;
+
+	Matrix(int rows = 0, int cols = 0) : rows(rows), cols(cols), values((size_t)rows * cols, 0.0) {}
+
+	double *row(int i)
+	{
+		return &values[(size_t)i * cols];
+	}
+
+	const double *row(int i) const
+	{
+		return &values[(size_t)i * cols];
+	}
+};
+
+// C = A * B, parallel over blocks of rows of A
+Matrix multiply(const Matrix &A, const Matrix &B)
+{
+	Matrix C(A.rows, B.cols);
+
+	#pragma omp parallel for schedule(dynamic)
+	for (int block = 0; block < A.rows; block += BLOCK_ROWS) {
+		int block_end = min(block + BLOCK_ROWS, A.rows);
+		for (int i = block; i < block_end; i++) {
+			double *c = C.row(i);
+			const double *a = A.row(i);
+			for (int k = 0; k < A.cols; k++) {
+				const double *b = B.row(k);
+				double a_ik = a[k];
+				for (int j = 0; j < B.cols; j++)
+					c[j] += a_ik * b[j];
+			}
+		}
+	}
+	return C;
+}
+
+// C = A^T * B, each thread accumulates a partial product over its blocks of rows
+Matrix multiplyTransposed(const Matrix &A, const Matrix &B)
+{
+	Matrix C(A.cols, B.cols);
+
+	#pragma omp parallel
+	{
+		Matrix partial(A.cols, B.cols);
+
+		#pragma omp for schedule(dynamic)
+		for (int block = 0; block < A.rows; block += BLOCK_ROWS) {
+			int block_end = min(block + BLOCK_ROWS, A.rows);
+			for (int i = block; i < block_end; i++) {
+				const double *a = A.row(i);
+				const double *b = B.row(i);
+				for (int k = 0; k < A.cols; k++) {
+					double *p = partial.row(k);
+					double a_ik = a[k];
+					for (int j = 0; j < B.cols; j++)
+						p[j] += a_ik * b[j];
+				}
+			}
+		}
+
+		#pragma omp critical
+		for (size_t i = 0; i < C.values.size(); i++)
+			C.values[i] += partial.values[i];
+	}
+	return C;
+}
+
+// orthonormalizes the columns of A in place (modified Gram-Schmidt)
+void orthonormalize(Matrix &A)
+{
+	for (int j = 0; j < A.cols; j++) {
+		for (int p = 0; p < j; p++) {
+			double dot = 0.0;
+			#pragma omp parallel for reduction(+:dot)
+			for (int i = 0; i < A.rows; i++)
+				dot += A.row(i)[j] * A.row(i)[p];
+			#pragma omp parallel for
+			for (int i = 0; i < A.rows; i++)
+				A.row(i)[j] -= dot * A.row(i)[p];
+		}
+
+		double norm = 0.0;
+		#pragma omp parallel for reduction(+:norm)
+		for (int i = 0; i < A.rows; i++)
+			norm += A.row(i)[j] * A.row(i)[j];
+		norm = sqrt(norm);
+		if (norm == 0.0)
+			continue;
+		#pragma omp parallel for
+		for (int i = 0; i < A.rows; i++)
+			A.row(i)[j] /= norm;
+	}
+}
+
+// eigenvectors of the symmetric matrix S (cyclic Jacobi), sorted by decreasing eigenvalue
+Matrix eigenvectors(Matrix S, vector<double> &eigenvalues)
+{
+	int n = S.rows;
+	Matrix V(n, n);
+	for (int i = 0; i < n; i++)
+		V.row(i)[i] = 1.0;
+
+	for (int sweep = 0; sweep < 100; sweep++) {
+		double off = 0.0;
+		for (int p = 0; p < n; p++)
+			for (int q = p + 1; q < n; q++)
+				off += S.row(p)[q] * S.row(p)[q];
+		if (off < 1e-22)
+			break;
+
+		for (int p = 0; p < n; p++) {
+			for (int q = p + 1; q < n; q++) {
+				if (S.row(p)[q] == 0.0)
+					continue;
+				double theta = (S.row(q)[q] - S.row(p)[p]) / (2.0 * S.row(p)[q]);
+				double t = (theta >= 0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+				double c = 1.0 / sqrt(t * t + 1.0), s = t * c;
+
+				for (int k = 0; k < n; k++) {
+					double skp = S.row(k)[p], skq = S.row(k)[q];
+					S.row(k)[p] = c * skp - s * skq;
+					S.row(k)[q] = s * skp + c * skq;
+				}
+				for (int k = 0; k < n; k++) {
+					double spk = S.row(p)[k], sqk = S.row(q)[k];
+					S.row(p)[k] = c * spk - s * sqk;
+					S.row(q)[k] = s * spk + c * sqk;
+				}
+				for (int k = 0; k < n; k++) {
+					double vkp = V.row(k)[p], vkq = V.row(k)[q];
+					V.row(k)[p] = c * vkp - s * vkq;
+					V.row(k)[q] = s * vkp + c * vkq;
+				}
+			}
+		}
+	}
+
+	vector<int> order(n);
+	for (int i = 0; i < n; i++)
+		order[i] = i;
+	sort(order.begin(), order.end(), [&](int a, int b) { return S.row(a)[a] > S.row(b)[b]; });
+
+	Matrix sorted(n, n);
+	eigenvalues.resize(n);
+	for (int j = 0; j < n; j++) {
+		eigenvalues[j] = S.row(order[j])[order[j]];
+		for (int i = 0; i < n; i++)
+			sorted.row(i)[j] = V.row(i)[order[j]];
+	}
+	return sorted;
+}
+
+// projects the centered points onto their top principal directions
+Matrix randomizedPCA(const Matrix &X, int reduced_values, mt19937 &generator)
+{
+	int sketch = min(reduced_values + OVERSAMPLING, min(X.rows, X.cols));
+	normal_distribution<double> normal(0.0, 1.0);
+
+	Matrix omega(X.cols, sketch);
+	for (double &v : omega.values)
+		v = normal(generator);
+
+	// range finder with power iterations: Q spans the dominant column space of X
+	Matrix Q = multiply(X, omega);
+	orthonormalize(Q);
+	for (int it = 0; it < POWER_ITERATIONS; it++) {
+		Matrix W = multiplyTransposed(X, Q);
+		orthonormalize(W);
+		Q = multiply(X, W);
+		orthonormalize(Q);
+	}
+
+	// B^T = X^T Q; the right singular vectors of B are the eigenvectors of B^T B
+	Matrix Bt = multiplyTransposed(X, Q);
+	Matrix BBt = multiplyTransposed(Bt, Bt);
+	vector<double> eigenvalues;
+	Matrix U = eigenvectors(BBt, eigenvalues);
+
+	int kept = min(reduced_values, sketch);
+	Matrix directions(X.cols, kept);
+	for (int j = 0; j < kept; j++) {
+		double sigma = sqrt(max(eigenvalues[j], 0.0));
+		if (sigma == 0.0)
+			continue;
+		for (int i = 0; i < X.cols; i++) {
+			double v = 0.0;
+			for (int p = 0; p < sketch; p++)
+				v += Bt.row(i)[p] * U.row(p)[j];
+			directions.row(i)[j] = v / sigma;
+		}
+	}
+
+	return multiply(X, directions);
+}
+
+// projects the points with a very sparse random matrix with entries in {-1, 0, +1}
+Matrix sparseRandomProjection(const Matrix &X, int reduced_values, mt19937 &generator)
+{
+	double s = sqrt((double)X.cols);
+	double scale = sqrt(s / reduced_values);
+	uniform_real_distribution<double> uniform(0.0, 1.0);
+
+	// nonzeros of each row of the projection matrix
+	vector<vector<pair<int, double>>> projection(X.cols);
+	for (int i = 0; i < X.cols; i++) {
+		for (int j = 0; j < reduced_values; j++) {
+			double u = uniform(generator);
+			if (u < 1.0 / (2.0 * s))
+				projection[i].push_back(make_pair(j, scale));
+			else if (u < 1.0 / s)
+				projection[i].push_back(make_pair(j, -scale));
+		}
+	}
+
+	Matrix Z(X.rows, reduced_values);
+	#pragma omp parallel for schedule(dynamic)
+	for (int block = 0; block < X.rows; block += BLOCK_ROWS) {
+		int block_end = min(block + BLOCK_ROWS, X.rows);
+		for (int r = block; r < block_end; r++) {
+			const double *x = X.row(r);
+			double *z = Z.row(r);
+			for (int i = 0; i < X.cols; i++) {
+				if (x[i] == 0.0)
+					continue;
+				for (const pair<int, double> &entry : projection[i])
+					z[entry.first] += x[i] * entry.second;
+			}
+		}
+	}
+	return Z;
+}
+
+// sum of squared distances of each point to its centroid
+double inertia(const Matrix &points, const Matrix &centroids, const vector<int> &assignments)
+{
+	double total = 0.0;
+
+	#pragma omp parallel for reduction(+:total)
+	for (int i = 0; i < points.rows; i++) {
+		const double *p = points.row(i);
+		const double *c = centroids.row(assignments[i]);
+		for (int j = 0; j < points.cols; j++)
+			total += (p[j] - c[j]) * (p[j] - c[j]);
+	}
+	return total;
+}
+
+class KMeans
+{
+private:
+	int K;
+	int total_points, max_iterations;
+	vector<int> assignments;
+	double reduced_inertia, refined_inertia;
+
+	// return ID of nearest center
+	int getIDNearestCenter(const double *point, const Matrix &centroids) const
+	{
+		double min_dist = INFINITY;
+		int id_cluster_center = 0;
+
+		for (int c = 0; c < K; c++) {
+			const double *centroid = centroids.row(c);
+			double sum = 0.0;
+			for (int j = 0; j < centroids.cols; j++) {
+				double diff = centroid[j] - point[j];
+				sum += diff * diff;
+			}
+			if (sum < min_dist) {
+				min_dist = sum;
+				id_cluster_center = c;
+			}
+		}
+		return id_cluster_center;
+	}
+
+	// sets each centroid to the mean of its points; empty clusters keep their centroid
+	void updateCentroids(const Matrix &points, Matrix &centroids) const
+	{
+		Matrix sums(K, points.cols);
+		vector<int> counts(K, 0);
+
+		#pragma omp parallel
+		{
+			Matrix partial(K, points.cols);
+			vector<int> partial_counts(K, 0);
+
+			#pragma omp for schedule(static)
+			for (int i = 0; i < points.rows; i++) {
+				int c = assignments[i];
+				const double *p = points.row(i);
+				double *sum = partial.row(c);
+				for (int j = 0; j < points.cols; j++)
+					sum[j] += p[j];
+				partial_counts[c]++;
+			}
+
+			#pragma omp critical
+			{
+				for (size_t i = 0; i < sums.values.size(); i++)
+					sums.values[i] += partial.values[i];
+				for (int c = 0; c < K; c++)
+					counts[c] += partial_counts[c];
+			}
+		}
+
+		for (int c = 0; c < K; c++) {
+			if (counts[c] == 0)
+				continue;
+			for (int j = 0; j < points.cols; j++)
+				centroids.row(c)[j] = sums.row(c)[j] / counts[c];
+		}
+	}
+
+	// Lloyd iterations on the given points; returns true if the assignments converged
+	bool lloyd(const Matrix &points, Matrix &centroids, int iterations)
+	{
+		for (int iter = 1; iter <= iterations; iter++) {
+			int changed = 0;
+
+			#pragma omp parallel for reduction(+:changed) schedule(static)
+			for (int i = 0; i < points.rows; i++) {
+				int c = getIDNearestCenter(points.row(i), centroids);
+				if (assignments[i] != c) {
+					assignments[i] = c;
+					changed = 1;
+				}
+			}
+
+			updateCentroids(points, centroids);
+
+			if (changed == 0)
+				return true;
+		}
+		return false;
+	}
+
+public:
+	KMeans(int K, int total_points, int max_iterations)
+	{
+		this->K = K;
+		this->total_points = total_points;
+		this->max_iterations = max_iterations;
+		reduced_inertia = refined_inertia = 0.0;
+	}
+
+	double getReducedInertia() const
+	{
+		return reduced_inertia;
+	}
+
+	double getRefinedInertia() const
+	{
+		return refined_inertia;
+	}
+
+	long long run(const Matrix &points, const Matrix &reduced_points)
+	{
+		auto begin = chrono::high_resolution_clock::now();
+
+		if (K > total_points)
+			return 0;
+
+		vector<int> prohibited_indexes;
+		Matrix reduced_centroids(K, reduced_points.cols);
+		assignments.assign(total_points, -1);
+
+		// choose K distinct values for the centers of the clusters
+		for (int i = 0; i < K; i++)
+		{
+			while (true)
+			{
+				int index_point = rand() % total_points;
+
+				if (find(prohibited_indexes.begin(), prohibited_indexes.end(),
+						 index_point) == prohibited_indexes.end())
+				{
+					prohibited_indexes.push_back(index_point);
+					for (int j = 0; j < reduced_points.cols; j++)
+						reduced_centroids.row(i)[j] = reduced_points.row(index_point)[j];
+					break;
+				}
+			}
+		}
+
+		lloyd(reduced_points, reduced_centroids, max_iterations);
+
+		// lifts the reduced solution back to the full space; clusters left empty by the
+		// reduced Lloyd keep the full-dimension values of their seed point
+		Matrix centroids(K, points.cols);
+		for (int i = 0; i < K; i++)
+			for (int j = 0; j < points.cols; j++)
+				centroids.row(i)[j] = points.row(prohibited_indexes[i])[j];
+		updateCentroids(points, centroids);
+		auto end_reduced = chrono::high_resolution_clock::now();
+
+		reduced_inertia = inertia(points, centroids, assignments);
+
+		auto begin_refine = chrono::high_resolution_clock::now();
+		if (REFINE_ITERATIONS > 0)
+			lloyd(points, centroids, REFINE_ITERATIONS);
+		auto end = chrono::high_resolution_clock::now();
+
+		refined_inertia = inertia(points, centroids, assignments);
+
+		long long duration = duration_cast<microseconds>(end_reduced - begin).count() +
+							 duration_cast<microseconds>(end - begin_refine).count();
+
+		return duration;
+	}
+};
+
+int main(int argc, char *argv[])
+{
+	srand(10);
+
+	int total_points, total_values, K, max_iterations, has_name;
+
+	cin >> total_points >> total_values >> K >> max_iterations >> has_name;
+
+	Matrix points(total_points, total_values);
+	string point_name;
+
+	for (int i = 0; i < total_points; i++)
+	{
+		for (int j = 0; j < total_values; j++)
+			cin >> points.row(i)[j];
+
+		if (has_name)
+			cin >> point_name;
+	}
+
+	// the projection is computed once, on mean-centered data, and shared by every K and run
+	auto reduction_begin = chrono::high_resolution_clock::now();
+
+	Matrix centered = points;
+	vector<double> mean(total_values, 0.0);
+	for (int i = 0; i < total_points; i++)
+		for (int j = 0; j < total_values; j++)
+			mean[j] += points.row(i)[j] / total_points;
+	for (int i = 0; i < total_points; i++)
+		for (int j = 0; j < total_values; j++)
+			centered.row(i)[j] -= mean[j];
+
+	int reduced_values = min(REDUCED_VALUES, total_values);
+	mt19937 generator(10);
+	Matrix reduced_points = (REDUCTION_METHOD == 0) ?
+		randomizedPCA(centered, reduced_values, generator) :
+		sparseRandomProjection(centered, reduced_values, generator);
+
+	auto reduction_end = chrono::high_resolution_clock::now();
+	cout << "REDUCTION TIME = " << duration_cast<microseconds>(reduction_end - reduction_begin).count()
+		 << " (" << total_values << " -> " << reduced_points.cols << " values)" << endl;
+
+	cout << "K,AverageTimeMicroseconds,ReducedInertia,RefinedInertia,InertiaGapPercent" << endl;
+	int k_vals[] = {2, 3, 5, 10, 20};
+	for (int K : k_vals) {
+		long long total_time = 0;
+		double total_reduced = 0.0, total_refined = 0.0;
+		int numRuns = 25;
+		for (int r = 0; r < numRuns; r++) {
+			KMeans kmeans(K, total_points, max_iterations);
+			total_time += kmeans.run(points, reduced_points);
+			total_reduced += kmeans.getReducedInertia();
+			total_refined += kmeans.getRefinedInertia();
+		}
+		long long avg_time = total_time / numRuns;
+		double gap = (total_refined > 0.0) ? 100.0 * (total_reduced - total_refined) / total_refined : 0.0;
+		cout << K << "," << avg_time << "," << total_reduced / numRuns << ","
+			 << total_refined / numRuns << "," << gap << endl;
+	}
+
+	return 0;
+}
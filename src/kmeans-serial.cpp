@@ -9,20 +9,39 @@
 #include <algorithm>
 #include <chrono>
 #include <sstream>
+#include "result_writer.h"
 
 using namespace std;
 using namespace std::chrono;
 
+// build with -DCOSINE_METRIC for spherical k-means: points and centroids are kept at unit
+// length, where the nearest centroid in Euclidean distance is also the nearest in angle
+void normalize(vector<double>& values)
+{
+	double norm = 0.0;
+
+	for(size_t j = 0; j < values.size(); j++)
+		norm += values[j] * values[j];
+
+	if(norm == 0.0)
+		return;
+
+	norm = sqrt(norm);
+	for(size_t j = 0; j < values.size(); j++)
+		values[j] /= norm;
+}
+
 class Point
 {
 private:
 	int id_point, id_cluster;
 	vector<double> values;
 	int total_values;
+	double weight;
 	string name;
 
 public:
-	Point(int id_point, vector<double>& values, string name = "")
+	Point(int id_point, vector<double>& values, string name = "", double weight = 1.0)
 	{
 		this->id_point = id_point;
 		total_values = values.size();
@@ -31,6 +50,7 @@ public:
 			this->values.push_back(values[i]);
 
 		this->name = name;
+		this->weight = weight;
 		id_cluster = -1;
 	}
 
@@ -64,6 +84,11 @@ public:
 		values.push_back(value);
 	}
 
+	double getWeight()
+	{
+		return weight;
+	}
+
 	string getName()
 	{
 		return name;
@@ -142,6 +167,7 @@ private:
 	int K; // number of clusters
 	int total_values, total_points, max_iterations;
 	vector<Cluster> clusters;
+	long long total_time, phase1_time;
 
 	// return ID of nearest center
 	int getIDNearestCenter(Point point)
@@ -251,11 +277,31 @@ public:
 
 					if(total_points_cluster > 0)
 					{
+#ifdef WEIGHTED_POINTS
+						double total_weight = 0.0;
+						for(int p = 0; p < total_points_cluster; p++)
+						{
+							Point point = clusters[i].getPoint(p);
+							sum += point.getWeight() * point.getValue(j);
+							total_weight += point.getWeight();
+						}
+						clusters[i].setCentralValue(j, sum / total_weight);
+#else
 						for(int p = 0; p < total_points_cluster; p++)
 							sum += clusters[i].getPoint(p).getValue(j);
 						clusters[i].setCentralValue(j, sum / total_points_cluster);
+#endif
 					}
 				}
+
+#ifdef COSINE_METRIC
+				vector<double> central_values;
+				for(int j = 0; j < total_values; j++)
+					central_values.push_back(clusters[i].getCentralValue(j));
+				normalize(central_values);
+				for(int j = 0; j < total_values; j++)
+					clusters[i].setCentralValue(j, central_values[j]);
+#endif
 			}
 
 			if(done == true || iter >= max_iterations)
@@ -269,44 +315,31 @@ public:
         auto end = chrono::high_resolution_clock::now();
 		long long duration = duration_cast<microseconds>(end - begin).count();
 
-		cout << "--------------------------------------------------" << endl;
-		// shows elements of clusters
-		for(int i = 0; i < K; i++)
-		{
-			int total_points_cluster =  clusters[i].getTotalPoints();
-	
-			cout << "Cluster " << clusters[i].getID() + 1 << endl;
-			for(int j = 0; j < total_points_cluster; j++)
-			{
-				cout << "Point " << clusters[i].getPoint(j).getID() + 1 << ": ";
-				for(int p = 0; p < total_values; p++)
-					cout << clusters[i].getPoint(j).getValue(p) << " ";
-	
-				string point_name = clusters[i].getPoint(j).getName();
-	
-				if(point_name != "")
-					cout << "- " << point_name;
-	
-				cout << endl;
-			}
-	
-			cout << "Cluster values: ";
-	
-			for(int j = 0; j < total_values; j++)
-				cout << clusters[i].getCentralValue(j) << " ";
-	
-			cout << "\n\n";
-			cout << "TOTAL EXECUTION TIME = "<<std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count()<<"\n";
-	
-			cout << "TIME PHASE 1 = "<<std::chrono::duration_cast<std::chrono::microseconds>(end_phase1-begin).count()<<"\n";
-	
-			cout << "TIME PHASE 2 = "<<std::chrono::duration_cast<std::chrono::microseconds>(end-end_phase1).count()<<"\n";
-		}
-		cout << "--------------------------------------------------" << endl;
+		total_time = duration;
+		phase1_time = duration_cast<microseconds>(end_phase1 - begin).count();
 
 		return duration;
 		// return iter;
 	}
+
+	// collects the assignments and centroids of the last run for the result writer
+	RunResult getResult(vector<Point> & points, int run)
+	{
+		RunResult result;
+		result.K = K;
+		result.run = run;
+		result.total_time = total_time;
+		result.phase1_time = phase1_time;
+
+		for(int i = 0; i < total_points; i++)
+			result.assignments.push_back(points[i].getCluster());
+
+		for(size_t i = 0; i < clusters.size(); i++)
+			for(int j = 0; j < total_values; j++)
+				result.centroids.push_back(clusters[i].getCentralValue(j));
+
+		return result;
+	}
 };
 
 int main(int argc, char *argv[])
@@ -331,19 +364,43 @@ int main(int argc, char *argv[])
 			values.push_back(value);
 		}
 
+#ifdef COSINE_METRIC
+		normalize(values);
+#endif
+
+		// a weight after the values makes this point count that many times in its centroid
+		double weight = 1.0;
+#ifdef WEIGHTED_POINTS
+		cin >> weight;
+#endif
+
 		if(has_name)
 		{
 			cin >> point_name;
-			Point p(i, values, point_name);
+			Point p(i, values, point_name, weight);
 			points.push_back(p);
 		}
 		else
 		{
-			Point p(i, values);
+			Point p(i, values, "", weight);
 			points.push_back(p);
 		}
 	}
 
+	vector<double> values, weights;
+	vector<string> names;
+	for(int i = 0; i < total_points; i++)
+	{
+		for(int j = 0; j < total_values; j++)
+			values.push_back(points[i].getValue(j));
+		weights.push_back(points[i].getWeight());
+		names.push_back(points[i].getName());
+	}
+	ResultWriter writer(total_points, total_values, std::move(values), std::move(names));
+#ifdef WEIGHTED_POINTS
+	writer.setWeights(std::move(weights));
+#endif
+
 	cout << "K,AverageTimeMicroseconds" << endl;
 	int k_vals[] = {2, 3, 5, 10, 20};
     for (int K : k_vals) {
@@ -353,7 +410,9 @@ int main(int argc, char *argv[])
             vector<Point> points_copy = points;
             KMeans kmeans(K, total_points, total_values, max_iterations);
             total_time += kmeans.run(points_copy);
+            writer.submit(kmeans.getResult(points_copy, r));
         }
+        writer.finishK();
         long long avg_time = total_time / numRuns;
         cout << K << "," << avg_time << endl;
     }
@@ -0,0 +1,351 @@
+// Implementation of the KMeans Algorithm for sparse data stored in CSR format
+// reference: https://github.com/marcoscastro/kmeans
+//
+// Input format: the usual header line "total_points total_values K max_iterations has_name",
+// followed by one line per point of the form "nnz index:value index:value ... [name]",
+// where indexes are 0-based and only the nonzero values are listed.
+
+#include <iostream>
+#include <vector>
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+using namespace std::chrono;
+
+// build with -DCOSINE_METRIC for cosine distance on text-like data: rows are normalised when they
+// are read and the centroids after every update, so |x|^2 - 2 x.c + |c|^2 = 2 - 2 cos(x, c)
+
+// points stored row by row in compressed sparse row format
+class SparseDataset
+{
+private:
+	int total_points, total_values;
+	vector<long long> row_offsets;  // total_points + 1 entries
+	vector<int> indexes;            // column of each nonzero
+	vector<double> values;          // value of each nonzero
+	vector<double> norms;           // squared norm of each point
+	vector<string> names;
+
+public:
+	SparseDataset(int total_values)
+	{
+		this->total_values = total_values;
+		total_points = 0;
+		row_offsets.push_back(0);
+	}
+
+	void addPoint(const vector<int> &point_indexes, const vector<double> &point_values, string name = "")
+	{
+		double norm = 0.0;
+
+		for (size_t k = 0; k < point_indexes.size(); k++)
+		{
+			indexes.push_back(point_indexes[k]);
+			values.push_back(point_values[k]);
+			norm += point_values[k] * point_values[k];
+		}
+
+		row_offsets.push_back(indexes.size());
+		norms.push_back(norm);
+		names.push_back(name);
+		total_points++;
+	}
+
+	long long getRowBegin(int point) const
+	{
+		return row_offsets[point];
+	}
+
+	long long getRowEnd(int point) const
+	{
+		return row_offsets[point + 1];
+	}
+
+	int getIndex(long long k) const
+	{
+		return indexes[k];
+	}
+
+	double getValue(long long k) const
+	{
+		return values[k];
+	}
+
+	double getNorm(int point) const
+	{
+		return norms[point];
+	}
+
+	string getName(int point) const
+	{
+		return names[point];
+	}
+
+	int getTotalPoints() const
+	{
+		return total_points;
+	}
+
+	int getTotalValues() const
+	{
+		return total_values;
+	}
+
+	long long getTotalNonzeros() const
+	{
+		return indexes.size();
+	}
+};
+
+class KMeans
+{
+private:
+	int K;
+	int total_values, total_points, max_iterations;
+	vector<double> centroids;       // dense, K * total_values
+	vector<double> centroid_norms;  // squared norm of each centroid
+	vector<int> assignments;
+
+	// points grouped by cluster for the centroid update: the points of cluster c are
+	// cluster_points[cluster_offsets[c] .. cluster_offsets[c + 1])
+	vector<int> cluster_offsets;
+	vector<int> cluster_points;
+
+	// return ID of nearest center, using |x|^2 - 2 x.c + |c|^2 with a sparse dot product
+	int getIDNearestCenter(const SparseDataset &data, int point) const
+	{
+		long long row_begin = data.getRowBegin(point), row_end = data.getRowEnd(point);
+		double norm = data.getNorm(point);
+		double min_dist = INFINITY;
+		int id_cluster_center = 0;
+
+		for (int c = 0; c < K; c++)
+		{
+			const double *centroid = &centroids[(size_t)c * total_values];
+			double dot = 0.0;
+
+			for (long long k = row_begin; k < row_end; k++)
+				dot += data.getValue(k) * centroid[data.getIndex(k)];
+
+			double dist = norm - 2.0 * dot + centroid_norms[c];
+			if (dist < min_dist)
+			{
+				min_dist = dist;
+				id_cluster_center = c;
+			}
+		}
+
+		return id_cluster_center;
+	}
+
+	void updateCentroidNorms()
+	{
+		for (int c = 0; c < K; c++)
+		{
+			double norm = 0.0;
+			for (int j = 0; j < total_values; j++)
+				norm += centroids[(size_t)c * total_values + j] * centroids[(size_t)c * total_values + j];
+			centroid_norms[c] = norm;
+		}
+	}
+
+public:
+	KMeans(int K, int total_points, int total_values, int max_iterations)
+	{
+		this->K = K;
+		this->total_points = total_points;
+		this->total_values = total_values;
+		this->max_iterations = max_iterations;
+	}
+
+	const vector<int> &getAssignments() const
+	{
+		return assignments;
+	}
+
+	long long run(const SparseDataset &data)
+	{
+		auto begin = chrono::high_resolution_clock::now();
+
+		if (K > total_points)
+			return 0;
+
+		vector<int> prohibited_indexes;
+		centroids.assign((size_t)K * total_values, 0.0);
+		centroid_norms.assign(K, 0.0);
+		assignments.assign(total_points, -1);
+
+		// choose K distinct values for the centers of the clusters
+		for (int i = 0; i < K; i++)
+		{
+			while (true)
+			{
+				int index_point = rand() % total_points;
+
+				if (find(prohibited_indexes.begin(), prohibited_indexes.end(),
+						 index_point) == prohibited_indexes.end())
+				{
+					prohibited_indexes.push_back(index_point);
+					for (long long k = data.getRowBegin(index_point); k < data.getRowEnd(index_point); k++)
+						centroids[(size_t)i * total_values + data.getIndex(k)] = data.getValue(k);
+					break;
+				}
+			}
+		}
+
+		cluster_offsets.resize(K + 1);
+		cluster_points.resize(total_points);
+
+		int iter = 1;
+
+		while (true)
+		{
+			int changed = 0;
+			updateCentroidNorms();
+
+			// associates each point to the nearest center
+			#pragma omp parallel for reduction(+:changed) schedule(static)
+			for (int i = 0; i < total_points; i++)
+			{
+				int c = getIDNearestCenter(data, i);
+
+				if (assignments[i] != c)
+				{
+					assignments[i] = c;
+					changed = 1;
+				}
+			}
+
+			// groups the points by cluster with a counting sort
+			fill(cluster_offsets.begin(), cluster_offsets.end(), 0);
+			for (int i = 0; i < total_points; i++)
+				cluster_offsets[assignments[i] + 1]++;
+			for (int c = 0; c < K; c++)
+				cluster_offsets[c + 1] += cluster_offsets[c];
+			{
+				vector<int> next(cluster_offsets.begin(), cluster_offsets.end() - 1);
+				for (int i = 0; i < total_points; i++)
+					cluster_points[next[assignments[i]]++] = i;
+			}
+
+			// recalculating the center of each cluster: every thread owns whole clusters and
+			// scatters their nonzeros straight into the shared centroids, so the update costs
+			// O(nnz) plus one pass over the rows of the non-empty clusters
+			#pragma omp parallel for schedule(dynamic)
+			for (int c = 0; c < K; c++)
+			{
+				int count = cluster_offsets[c + 1] - cluster_offsets[c];
+				if (count == 0)
+					continue;
+
+				double *centroid = &centroids[(size_t)c * total_values];
+				fill(centroid, centroid + total_values, 0.0);
+
+				for (int p = cluster_offsets[c]; p < cluster_offsets[c + 1]; p++)
+				{
+					int i = cluster_points[p];
+					for (long long k = data.getRowBegin(i); k < data.getRowEnd(i); k++)
+						centroid[data.getIndex(k)] += data.getValue(k);
+				}
+
+				for (int j = 0; j < total_values; j++)
+					centroid[j] /= count;
+
+#ifdef COSINE_METRIC
+				// spherical k-means: the centroids are kept at unit length like the points
+				double norm = 0.0;
+				for (int j = 0; j < total_values; j++)
+					norm += centroid[j] * centroid[j];
+				if (norm > 0.0)
+				{
+					norm = sqrt(norm);
+					for (int j = 0; j < total_values; j++)
+						centroid[j] /= norm;
+				}
+#endif
+			}
+
+			if (changed == 0 || iter >= max_iterations)
+				break;
+
+			iter++;
+		}
+		auto end = chrono::high_resolution_clock::now();
+		long long duration = duration_cast<microseconds>(end - begin).count();
+
+		return duration;
+	}
+};
+
+int main(int argc, char *argv[])
+{
+	srand(10);
+
+	int total_points, total_values, K, max_iterations, has_name;
+
+	cin >> total_points >> total_values >> K >> max_iterations >> has_name;
+
+	SparseDataset data(total_values);
+	string point_name;
+
+	for (int i = 0; i < total_points; i++)
+	{
+		int nnz;
+		cin >> nnz;
+
+		vector<int> indexes(nnz);
+		vector<double> values(nnz);
+		for (int k = 0; k < nnz; k++)
+		{
+			char separator;
+			cin >> indexes[k] >> separator >> values[k];
+
+			if (indexes[k] < 0 || indexes[k] >= total_values)
+			{
+				cerr << "Index " << indexes[k] << " out of range in point " << i + 1 << endl;
+				return -1;
+			}
+		}
+
+#ifdef COSINE_METRIC
+		double norm = 0.0;
+		for (int k = 0; k < nnz; k++)
+			norm += values[k] * values[k];
+		for (int k = 0; norm > 0.0 && k < nnz; k++)
+			values[k] /= sqrt(norm);
+#endif
+
+		if (has_name)
+		{
+			cin >> point_name;
+			data.addPoint(indexes, values, point_name);
+		}
+		else
+		{
+			data.addPoint(indexes, values);
+		}
+	}
+
+	cout << "K,AverageTimeMicroseconds" << endl;
+	int k_vals[] = {2, 3, 5, 10, 20};
+	for (int K : k_vals) {
+		long long total_time = 0;
+		int numRuns = 25;
+		for (int r = 0; r < numRuns; r++) {
+			KMeans kmeans(K, total_points, total_values, max_iterations);
+			total_time += kmeans.run(data);
+		}
+		long long avg_time = total_time / numRuns;
+		cout << K << "," << avg_time << endl;
+	}
+
+	return 0;
+}
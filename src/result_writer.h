@@ -0,0 +1,395 @@
+// Buffered, asynchronous writer for the assignments and centroids of each run.
+//
+// The engines hand every finished run to a ResultWriter instead of printing it; a background
+// thread formats the runs into a large buffer and writes it to RESULT_FILE, so the output never
+// interleaves with (or slows down) the timed clustering.
+//
+// Formats (RESULT_FORMAT):
+//   0  text:   the original "Cluster i / Point j: values - name / Cluster values: ..." listing
+//   1  csv:    "run,dataset,K,run,inertia" followed by "assignment,K,run,point,cluster" and
+//              "centroid,K,run,cluster,v0,v1,..." rows
+//   2  binary: "KMRS" followed by one record per run:
+//              int32 K, int32 run, int32 total_points, int32 total_values, double inertia,
+//              int32 name_length, char dataset[name_length],
+//              int32 assignments[total_points], double centroids[K * total_values]
+// With RESULT_BEST_ONLY set, only the run with the lowest inertia for each K is written.
+//
+// A writer built without a dataset accepts runs from any number of datasets (and from any
+// thread); the caller then labels each run and fills in its inertia. Its text listing gives
+// only the point numbers of each cluster.
+
+#ifndef RESULT_WRITER_H
+#define RESULT_WRITER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// writers shared by several datasets have no point values for the text listing, so they
+// default to csv unless RESULT_FORMAT is given
+#ifdef RESULT_FORMAT
+#define RESULT_SHARED_FORMAT RESULT_FORMAT
+#else
+#define RESULT_SHARED_FORMAT 1
+#endif
+
+#ifndef RESULT_FORMAT
+#define RESULT_FORMAT 0
+#endif
+
+#ifndef RESULT_BEST_ONLY
+#define RESULT_BEST_ONLY 0
+#endif
+
+#ifndef RESULT_FILE
+#define RESULT_FILE "kmeans-results.out"
+#endif
+
+// bytes buffered before each write
+#ifndef RESULT_BUFFER_SIZE
+#define RESULT_BUFFER_SIZE (1 << 22)
+#endif
+
+// runs waiting to be formatted before submit() blocks
+#ifndef RESULT_QUEUE_LIMIT
+#define RESULT_QUEUE_LIMIT 64
+#endif
+
+struct RunResult
+{
+	std::string dataset;                // label of the dataset, empty for single-dataset writers
+	int K, run;
+	long long total_time, phase1_time;  // microseconds
+	double inertia;                     // filled in by writers that own the dataset
+	std::vector<int> assignments;       // cluster of each point, in input order
+	std::vector<double> centroids;      // K * total_values
+};
+
+class ResultWriter
+{
+private:
+	bool has_dataset;
+	int total_points, total_values;
+	std::vector<double> values;   // total_points * total_values
+	std::vector<double> weights;  // empty when every point weighs 1
+	std::vector<std::string> names;
+	int format;
+	bool best_only;
+
+	// a finished run, or the marker that ends the runs of one K
+	struct QueuedRun
+	{
+		bool end_of_k;
+		RunResult result;
+	};
+
+	FILE *file;
+	std::string buffer;
+	std::deque<QueuedRun> queue;
+	std::mutex mutex;
+	std::condition_variable ready, space;
+	bool closing;
+	std::thread worker;
+
+	// best run of the current K in best-only mode; only touched by the background thread
+	bool has_best;
+	RunResult best;
+
+	double inertia(const RunResult &result) const
+	{
+		double total = 0.0;
+
+		for (int i = 0; i < total_points; i++) {
+			int c = result.assignments[i];
+			if (c < 0)
+				continue;
+			double dist = 0.0;
+			for (int j = 0; j < total_values; j++) {
+				double diff = values[(size_t)i * total_values + j] - result.centroids[(size_t)c * total_values + j];
+				dist += diff * diff;
+			}
+			total += weights.empty() ? dist : weights[i] * dist;
+		}
+		return total;
+	}
+
+	void append(const char *format_string, double value)
+	{
+		char text[64];
+		int length = snprintf(text, sizeof(text), format_string, value);
+		buffer.append(text, length);
+	}
+
+	void append(int value)
+	{
+		char text[16];
+		int length = snprintf(text, sizeof(text), "%d", value);
+		buffer.append(text, length);
+	}
+
+	void appendBinary(const void *data, size_t size)
+	{
+		buffer.append((const char *)data, size);
+	}
+
+	void formatText(const RunResult &result)
+	{
+		int total_points = result.assignments.size();
+		int total_values = result.centroids.size() / result.K;
+
+		buffer += "--------------------------------------------------\n";
+		if (!result.dataset.empty()) {
+			buffer += "Dataset ";
+			buffer += result.dataset;
+			buffer += "\n";
+		}
+
+		std::vector<std::vector<int>> cluster_points(result.K);
+		for (int i = 0; i < total_points; i++) {
+			int c = result.assignments[i];
+			if (c >= 0 && c < result.K)
+				cluster_points[c].push_back(i);
+		}
+
+		for (int c = 0; c < result.K; c++) {
+			buffer += "Cluster ";
+			append(c + 1);
+			buffer += "\n";
+
+			if (!has_dataset) {
+				buffer += "Points:";
+				for (int i : cluster_points[c]) {
+					buffer += " ";
+					append(i + 1);
+				}
+				buffer += "\n";
+			}
+			else {
+				for (int i : cluster_points[c]) {
+					buffer += "Point ";
+					append(i + 1);
+					buffer += ": ";
+					for (int j = 0; j < total_values; j++)
+						append("%g ", values[(size_t)i * total_values + j]);
+					if (!names[i].empty()) {
+						buffer += "- ";
+						buffer += names[i];
+					}
+					buffer += "\n";
+				}
+			}
+
+			buffer += "Cluster values: ";
+			for (int j = 0; j < total_values; j++)
+				append("%g ", result.centroids[(size_t)c * total_values + j]);
+			buffer += "\n\n";
+
+			buffer += "TOTAL EXECUTION TIME = ";
+			append("%.0f", (double)result.total_time);
+			buffer += "\nTIME PHASE 1 = ";
+			append("%.0f", (double)result.phase1_time);
+			buffer += "\nTIME PHASE 2 = ";
+			append("%.0f", (double)(result.total_time - result.phase1_time));
+			buffer += "\n";
+		}
+		buffer += "--------------------------------------------------\n";
+	}
+
+	void formatCSV(const RunResult &result)
+	{
+		int total_points = result.assignments.size();
+		int total_values = result.centroids.size() / result.K;
+
+		buffer += "run,";
+		buffer += result.dataset;
+		buffer += ",";
+		append(result.K);
+		buffer += ",";
+		append(result.run);
+		append(",%.17g\n", result.inertia);
+
+		for (int i = 0; i < total_points; i++) {
+			buffer += "assignment,";
+			append(result.K);
+			buffer += ",";
+			append(result.run);
+			buffer += ",";
+			append(i);
+			buffer += ",";
+			append(result.assignments[i]);
+			buffer += "\n";
+		}
+
+		for (int c = 0; c < result.K; c++) {
+			buffer += "centroid,";
+			append(result.K);
+			buffer += ",";
+			append(result.run);
+			buffer += ",";
+			append(c);
+			for (int j = 0; j < total_values; j++)
+				append(",%.17g", result.centroids[(size_t)c * total_values + j]);
+			buffer += "\n";
+		}
+	}
+
+	void formatBinary(const RunResult &result)
+	{
+		int32_t total_points = result.assignments.size();
+		int32_t header[4] = { result.K, result.run, total_points, (int32_t)(result.centroids.size() / result.K) };
+		appendBinary(header, sizeof(header));
+		appendBinary(&result.inertia, sizeof(double));
+
+		int32_t name_length = result.dataset.size();
+		appendBinary(&name_length, sizeof(name_length));
+		appendBinary(result.dataset.data(), name_length);
+
+		for (int i = 0; i < total_points; i++) {
+			int32_t c = result.assignments[i];
+			appendBinary(&c, sizeof(c));
+		}
+		appendBinary(result.centroids.data(), result.centroids.size() * sizeof(double));
+	}
+
+	void formatRun(const RunResult &result)
+	{
+		if (format == 2)
+			formatBinary(result);
+		else if (format == 1)
+			formatCSV(result);
+		else
+			formatText(result);
+
+		if (buffer.size() >= RESULT_BUFFER_SIZE)
+			flushBuffer();
+	}
+
+	void flushBuffer()
+	{
+		if (!buffer.empty() && file != NULL)
+			fwrite(buffer.data(), 1, buffer.size(), file);
+		buffer.clear();
+	}
+
+	void work()
+	{
+		while (true) {
+			QueuedRun entry;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				ready.wait(lock, [this] { return closing || !queue.empty(); });
+				if (queue.empty())
+					break;
+				entry = std::move(queue.front());
+				queue.pop_front();
+			}
+			space.notify_one();
+
+			if (entry.end_of_k) {
+				if (has_best)
+					formatRun(best);
+				has_best = false;
+				continue;
+			}
+
+			RunResult &result = entry.result;
+			if (has_dataset)
+				result.inertia = inertia(result);
+
+			if (!best_only)
+				formatRun(result);
+			else if (!has_best || result.inertia < best.inertia) {
+				best = std::move(result);
+				has_best = true;
+			}
+		}
+		flushBuffer();
+	}
+
+	void open(const char *path)
+	{
+		buffer.reserve(RESULT_BUFFER_SIZE + (1 << 16));
+
+		file = fopen(path, format == 2 ? "wb" : "w");
+		if (file == NULL)
+			fprintf(stderr, "Could not open %s for writing\n", path);
+		else if (format == 2)
+			fwrite("KMRS", 1, 4, file);
+
+		worker = std::thread(&ResultWriter::work, this);
+	}
+
+	void enqueue(bool end_of_k, RunResult &&result)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			space.wait(lock, [this] { return queue.size() < RESULT_QUEUE_LIMIT; });
+			queue.push_back(QueuedRun { end_of_k, std::move(result) });
+		}
+		ready.notify_one();
+	}
+
+public:
+	// the values and names are moved in, so callers that no longer need them should pass them with std::move
+	ResultWriter(int total_points, int total_values, std::vector<double> values, std::vector<std::string> names,
+				 const char *path = RESULT_FILE, int format = RESULT_FORMAT, bool best_only = RESULT_BEST_ONLY)
+		: has_dataset(true), total_points(total_points), total_values(total_values),
+		  values(std::move(values)), names(std::move(names)),
+		  format(format), best_only(best_only), closing(false), has_best(false)
+	{
+		this->names.resize(total_points);
+		open(path);
+	}
+
+	// writer shared by runs over several datasets
+	ResultWriter(const char *path = RESULT_FILE, int format = RESULT_SHARED_FORMAT)
+		: has_dataset(false), total_points(0), total_values(0),
+		  format(format), best_only(false), closing(false), has_best(false)
+	{
+		open(path);
+	}
+
+	~ResultWriter()
+	{
+		finishK();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closing = true;
+		}
+		ready.notify_one();
+		worker.join();
+
+		if (file != NULL)
+			fclose(file);
+	}
+
+	// weights of the points, so the inertia of weighted runs counts each point by its weight
+	void setWeights(std::vector<double> weights)
+	{
+		this->weights = std::move(weights);
+	}
+
+	// hands a finished run to the writer; runs without centroids (K > total_points) are skipped
+	void submit(RunResult &&result)
+	{
+		if (result.K <= 0 || result.centroids.empty() ||
+			(has_dataset && result.centroids.size() != (size_t)result.K * total_values))
+			return;
+
+		enqueue(false, std::move(result));
+	}
+
+	// ends the runs of the current K; in best-only mode this writes the best of them
+	void finishK()
+	{
+		if (best_only)
+			enqueue(true, RunResult());
+	}
+};
+
+#endif